@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include "agent.h"
+
+namespace snmp
+{
+    // Encoded size of a TLV with contents of the given length.
+    static size_t tlvSize(size_t length)
+    {
+        return 1 + MultibyteLen(length).getSize() + length;
+    }
+
+    Agent::Agent(const MibRegistry& _mib,const std::string& _community,std::pmr::memory_resource* resource) :
+        mib(_mib), community(_community), max_size(default_max_size), limit(0), request(resource), request_community(resource), varbinds(resource), varbinds_length(0), cursors(resource), max_templates(default_max_templates), request_id_mark(0), request_id_length(0), metrics(0)
+    {
+    }
+
+    size_t Agent::messageSize(size_t varbinds_length,const Integer& error,const Integer& index) const
+    {
+        size_t pdu = request_id.getSize() + error.getSize() + index.getSize() + tlvSize(varbinds_length);
+        return tlvSize(version.getSize() + request_community.getSize() + tlvSize(pdu));
+    }
+
+    bool Agent::fits(const Varbind& vb) const
+    {
+        return messageSize(varbinds_length + vb.getSize(),Integer(0),Integer(0)) <= limit;
+    }
+
+    void Agent::add(Varbind&& vb)
+    {
+        varbinds_length += vb.getSize();
+        varbinds.push_back(std::move(vb));
+    }
+
+    size_t Agent::drop()
+    {
+        if(metrics)
+            metrics->add(Metrics::dropped);
+        return 0;
+    }
+
+    size_t Agent::respond(const std::uint8_t* b,const std::uint8_t* e,std::uint8_t* out,size_t n)
+    {
+        std::uint64_t start = metrics ? Metrics::now() : 0;
+        size_t size;
+        try
+        {
+            Status status;
+            if(request.read(b,e,status) == 0)
+            {
+                if(metrics)
+                    metrics->failed(status.code);
+                return drop();
+            }
+            version = request.getVersion();
+            if(version.getValue() != v1 && version.getValue() != v2c)
+                return drop();
+            request_community = request.getCommunity();
+            if(request_community.getLength() != community.size() || std::memcmp(static_cast<const char*>(request_community),community.data(),community.size()) != 0)
+                return drop();
+            request_id = request.getRequestID();
+            limit = std::min(n,max_size);
+            if(metrics)
+            {
+                metrics->decoded(request.getPDUType());
+                start = metrics->lap(Metrics::decode,start);
+            }
+            size = answer(start,out);
+        }
+        catch(const Except& ex)
+        {
+            // read() checks only the framing; the fields are decoded when
+            // used and throw if malformed.
+            if(metrics)
+                metrics->failed(ex.getCode());
+            return drop();
+        }
+        catch(const std::bad_alloc&)
+        {
+            // Copying the community or the varbinds into the arena.
+            if(metrics)
+                metrics->failed(Except::no_memory);
+            return drop();
+        }
+        if(size == 0)
+            return drop();
+        if(metrics)
+            metrics->encoded(Complex::get_response);
+        return size;
+    }
+
+    // Handles the decoded request; start is when decoding finished.
+    size_t Agent::answer(std::uint64_t start,std::uint8_t* out)
+    {
+        bool cacheable = max_templates > 0 && (request.getPDUType() == Complex::get_request || request.getPDUType() == Complex::get_next_request);
+        if(cacheable)
+        {
+            key.assign(1,static_cast<char>(request.getPDUType()));
+            key.push_back(static_cast<char>(version.getValue()));
+            key.append(reinterpret_cast<const char*>(request.getVarbindsBegin()),request.getVarbindsEnd() - request.getVarbindsBegin());
+            std::unordered_map<std::string,Template>::const_iterator t = templates.find(key);
+            if(t != templates.end())
+            {
+                size_t size = patch(t->second,request.getPDUType() == Complex::get_next_request,out);
+                if(size != 0)
+                {
+                    // Answering and encoding are one step here.
+                    if(metrics)
+                        metrics->lap(Metrics::handler,start);
+                    return size;
+                }
+            }
+        }
+
+        varbinds.clear();
+        varbinds_length = 0;
+        std::int32_t error = PDU::noError;
+        std::int32_t index = 0;
+        switch(request.getPDUType())
+        {
+        case Complex::get_request:
+            error = get(false,index);
+            break;
+        case Complex::get_next_request:
+            error = get(true,index);
+            break;
+        case Complex::get_bulk_request:
+            if(version.getValue() == v1)
+                return 0;
+            getBulk();
+            break;
+        case Complex::set_request:
+            error = setError(index);
+            break;
+        default:
+            return 0;
+        }
+
+        if(error != PDU::noError)
+        {
+            // Errors echo the request varbinds, or none at all if even those
+            // do not fit. tooBig never does (RFC 3416 4.2.1).
+            varbinds.clear();
+            varbinds_length = 0;
+            if(error != PDU::tooLarge)
+            {
+                for(size_t i = 0;i < request.getVarbindCount();i++)
+                    add(request.getVarbind(i));
+            }
+            if(messageSize(varbinds_length,Integer(error),Integer(index)) > limit)
+            {
+                error = PDU::tooLarge;
+                index = 0;
+                varbinds.clear();
+                varbinds_length = 0;
+            }
+        }
+
+        if(metrics)
+            start = metrics->lap(Metrics::handler,start);
+        size_t size = encode(error,index,out);
+        if(metrics)
+            metrics->lap(Metrics::encode,start);
+        if(cacheable && error == PDU::noError)
+            store(out,size);
+        return size;
+    }
+
+    size_t Agent::encode(std::int32_t error,std::int32_t index,std::uint8_t* out)
+    {
+        Encoder enc(out,limit);
+        size_t m = enc.mark();
+        size_t p = enc.mark();
+        size_t vbs = enc.mark();
+        value_marks.resize(varbinds.size());
+        for(size_t i = varbinds.size();i > 0;i--)
+        {
+            size_t vb = enc.mark();
+            enc.writeValue(varbinds[i - 1]);
+            value_marks[i - 1] = std::make_pair(enc.mark(),enc.mark() - vb);
+            enc.write(varbinds[i - 1].getOid());
+            enc.close(Complex::sequence,vb);
+        }
+        enc.close(Complex::sequence,vbs);
+        enc.writeInteger(index);
+        enc.writeInteger(error);
+        size_t r = enc.mark();
+        enc.write(request_id);
+        request_id_mark = enc.mark();
+        request_id_length = request_id_mark - r;
+        enc.close(Complex::get_response,p);
+        enc.write(request_community);
+        enc.write(version);
+        enc.close(Complex::sequence,m);
+        std::memmove(out,enc.data(),enc.size());
+        return enc.size();
+    }
+
+    void Agent::store(const std::uint8_t* out,size_t n)
+    {
+        // Built aside, so that a failed allocation leaves no partial template.
+        Template t;
+        t.bytes.assign(out,out + n);
+        t.request_id = n - request_id_mark;
+        t.request_id_length = request_id_length;
+        for(size_t i = 0;i < varbinds.size();i++)
+        {
+            t.requested.push_back(request.getOid(i));
+            t.oids.push_back(varbinds[i].getOid());
+            t.values.push_back(std::make_pair(n - value_marks[i].first,value_marks[i].second));
+        }
+        if(templates.size() >= max_templates)
+            templates.clear();
+        templates[key] = std::move(t);
+    }
+
+    // Answers from the template on its own: the values are fetched for the
+    // oids the template was built from and written over the old ones.
+    // Returns 0 if the template no longer matches, out then holds garbage.
+    size_t Agent::patch(const Template& t,bool next,std::uint8_t* out)
+    {
+        if(t.bytes.size() > limit)
+            return 0;
+        // Every value was checked to fit the response, so it fits here too.
+        if(scratch.size() < limit)
+            scratch.resize(limit);
+        std::memcpy(out,t.bytes.data(),t.bytes.size());
+        Encoder enc(scratch.data(),scratch.size());
+        enc.write(request_id);
+        if(enc.size() != t.request_id_length)
+            return 0;
+        std::memcpy(out + t.request_id,enc.data(),enc.size());
+        for(size_t i = 0;i < t.oids.size();i++)
+        {
+            if(!(next ? mib.getNext(t.requested[i],value) : mib.get(t.requested[i],value)))
+                return 0;
+            if(next && !(value.getOid() == t.oids[i]))
+                return 0;
+            enc.reset();
+            enc.writeValue(value);
+            if(enc.size() != t.values[i].second)
+                return 0;
+            std::memcpy(out + t.values[i].first,enc.data(),enc.size());
+        }
+        return t.bytes.size();
+    }
+
+    std::int32_t Agent::get(bool next,std::int32_t& index)
+    {
+        for(size_t i = 0;i < request.getVarbindCount();i++)
+        {
+            Oid oid = request.getOid(i);
+            Varbind vb;
+            if(!(next ? mib.getNext(oid,vb) : mib.get(oid,vb)))
+            {
+                if(version.getValue() == v1)
+                {
+                    index = i + 1;
+                    return PDU::noSuchName;
+                }
+                vb = Varbind(oid,Null(next ? Primitive::tend_of_mib_view : Primitive::tno_such_instance));
+            }
+            if(!fits(vb))
+            {
+                index = 0;
+                return PDU::tooLarge;
+            }
+            add(std::move(vb));
+        }
+        return PDU::noError;
+    }
+
+    // RFC 3416 4.2.3: one GetNext for each of the first non-repeaters
+    // varbinds, then up to max-repetitions rounds of GetNext over the rest,
+    // stopping when every column has ended or the response is full.
+    void Agent::getBulk()
+    {
+        size_t count = request.getVarbindCount();
+        size_t non_repeaters = std::min<size_t>(std::max(request.getNonRepeaters().getValue(),0),count);
+        std::int32_t max_repetitions = std::max(request.getMaxRepetitions().getValue(),0);
+        for(size_t i = 0;i < non_repeaters;i++)
+        {
+            Oid oid = request.getOid(i);
+            Varbind vb;
+            if(!mib.getNext(oid,vb))
+                vb = Varbind(oid,Null(Primitive::tend_of_mib_view));
+            if(!fits(vb))
+                return;
+            add(std::move(vb));
+        }
+        cursors.clear();
+        for(size_t i = non_repeaters;i < count;i++)
+            cursors.push_back(request.getOid(i));
+        for(std::int32_t r = 0;r < max_repetitions && !cursors.empty();r++)
+        {
+            bool ended = true;
+            for(size_t i = 0;i < cursors.size();i++)
+            {
+                Varbind vb;
+                if(mib.getNext(cursors[i],vb))
+                {
+                    cursors[i] = vb.getOid();
+                    ended = false;
+                }
+                else
+                    vb = Varbind(cursors[i],Null(Primitive::tend_of_mib_view));
+                if(!fits(vb))
+                    return;
+                add(std::move(vb));
+            }
+            if(ended)
+                return;
+        }
+    }
+
+    std::int32_t Agent::setError(std::int32_t& index)
+    {
+        index = request.getVarbindCount() > 0 ? 1 : 0;
+        return version.getValue() == v1 ? PDU::noSuchName : PDU::notWritable;
+    }
+}
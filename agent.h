@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "snmp.h"
+#include "mib.h"
+#include "metrics.h"
+
+namespace snmp
+{
+    // Answers SNMPv1/v2c Get, GetNext and GetBulk requests from a MibRegistry.
+    // One Agent serves one thread: it keeps decoding state and scratch buffers
+    // between requests.
+    class Agent
+    {
+    public:
+        enum { default_max_size = 1472 }; // UDP payload of an unfragmented IPv4 datagram on Ethernet
+        enum { default_max_templates = 1024 };
+        // Decoding state is allocated from resource, which need not be
+        // thread-safe as long as the Agent stays on one thread.
+        Agent(const MibRegistry& _mib,const std::string& _community,std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+        void setMaxSize(size_t n) { max_size = n; }
+        size_t getMaxSize() const { return max_size; }
+        // Number of response templates kept for repeated Get/GetNext
+        // requests; 0 disables them.
+        void setMaxTemplates(size_t n) { max_templates = n; templates.clear(); }
+        size_t getMaxTemplates() const { return max_templates; }
+        // Where to count requests and time their stages; 0, the default,
+        // records nothing. Only this Agent's thread may write to it.
+        void setMetrics(Metrics* m) { metrics = m; }
+        // Decodes the request in [b,e) and writes the response to out. Returns
+        // the response length, or 0 if the request is to be dropped (malformed,
+        // wrong community, unsupported or out of memory). Responses never exceed the smaller
+        // of n and getMaxSize(); GetBulk responses are cut to fit, other
+        // requests get tooBig.
+        size_t respond(const std::uint8_t* b,const std::uint8_t* e,std::uint8_t* out,size_t n);
+    private:
+        // Encoded response to a Get or GetNext, keyed by the request varbind
+        // list. A repeated request is answered by copying it and overwriting
+        // the request-id and the values, as long as every one of them keeps
+        // its encoded length and GetNext still lands on the same instances.
+        struct Template
+        {
+            std::vector<std::uint8_t> bytes;
+            size_t request_id;
+            size_t request_id_length;
+            std::vector<Oid> requested;
+            std::vector<Oid> oids;
+            std::vector<std::pair<size_t,size_t>> values;
+        };
+        size_t answer(std::uint64_t start,std::uint8_t* out);
+        size_t drop();
+        size_t encode(std::int32_t error,std::int32_t index,std::uint8_t* out);
+        size_t patch(const Template& t,bool next,std::uint8_t* out);
+        void store(const std::uint8_t* out,size_t n);
+        std::int32_t get(bool next,std::int32_t& index);
+        void getBulk();
+        std::int32_t setError(std::int32_t& index);
+        bool fits(const Varbind& vb) const;
+        void add(Varbind&& vb);
+        size_t messageSize(size_t varbinds_length,const Integer& error,const Integer& index) const;
+        const MibRegistry& mib;
+        std::string community;
+        size_t max_size;
+        size_t limit;
+        MessageView request;
+        Integer version;
+        OctetString request_community;
+        Integer request_id;
+        std::pmr::vector<Varbind> varbinds;
+        size_t varbinds_length;
+        std::pmr::vector<Oid> cursors;
+        size_t max_templates;
+        std::unordered_map<std::string,Template> templates;
+        std::string key;
+        std::vector<std::uint8_t> scratch;
+        Varbind value;
+        // Positions counted from the end of the encoded response.
+        std::vector<std::pair<size_t,size_t>> value_marks;
+        size_t request_id_mark;
+        size_t request_id_length;
+        Metrics* metrics;
+    };
+}
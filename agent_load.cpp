@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <boost/asio.hpp>
+#include "snmp.h"
+#include "mib.h"
+#include "agent.h"
+#include "server.h"
+#include "datagram.h"
+
+// Load test of AgentServer over the loopback interface: client threads keep
+// a window of GetRequests in flight against 1, 2, 4 and 8 workers and the
+// answered requests per second are reported.
+
+using boost::asio::ip::udp;
+
+enum { clients = 8, window = 32 };
+
+typedef snmp::oid<1,3,6,1,2,1,1,3,0> sysUpTime;
+typedef snmp::oid<1,3,6,1,2,1,1,1,0> sysDescr;
+
+static std::vector<std::uint8_t> makeRequest()
+{
+    snmp::Message m(snmp::v2c,"public");
+    snmp::Varbinds vbs;
+    vbs.addVarbind(snmp::Varbind(sysUpTime::get()));
+    vbs.addVarbind(snmp::Varbind(sysDescr::get()));
+    m.setPDU(snmp::PDU(snmp::Complex::get_request,0x11223344,0,0,vbs));
+    std::vector<std::uint8_t> d;
+    m.write(d);
+    return d;
+}
+
+static void client(const udp::endpoint& server,const std::vector<std::uint8_t>& request,const std::atomic<bool>& running,std::atomic<std::uint64_t>& answered)
+{
+    boost::asio::io_service io_service;
+    udp::socket s(io_service,udp::endpoint(server.protocol(),0));
+    struct timeval tv = { 0, 20000 };
+    ::setsockopt(s.native_handle(),SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+    snmp::DatagramBatch out(window,0);
+    snmp::DatagramBatch in(window,snmp::Agent::default_max_size);
+    for(size_t i = 0;i < window;i++)
+        out.push(request.data(),request.size(),server);
+    std::uint64_t n = 0;
+    while(running.load(std::memory_order_relaxed))
+    {
+        boost::system::error_code ec;
+        for(size_t sent = 0;sent < out.size();)
+        {
+            sent += out.send(s.native_handle(),sent,ec);
+            if(ec)
+                sent++;
+        }
+        // Waits for the whole window, or until the timeout counts the rest
+        // as lost.
+        for(size_t got = 0;got < window;)
+        {
+            size_t r = in.receive(s.native_handle(),true,ec);
+            if(r == 0)
+                break;
+            got += r;
+            n += r;
+        }
+    }
+    answered += n;
+}
+
+int main(int argc,char* argv[])
+{
+    double seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+    snmp::MibRegistry mib;
+    mib.addScalar(sysUpTime::get(),[](const snmp::Oid& oid) { return snmp::Varbind(oid,snmp::TimeTicks(11111)); });
+    mib.addScalar(sysDescr::get(),[](const snmp::Oid& oid) { return snmp::Varbind(oid,snmp::OctetString("Test agenta SNMP")); });
+    std::vector<std::uint8_t> request = makeRequest();
+
+    std::cout << "hardware threads " << std::thread::hardware_concurrency() << ", " << clients << " clients, window " << window << std::endl;
+    std::cout << std::setw(8) << "workers" << std::setw(14) << "requests/s" << std::setw(10) << "dropped" << std::endl;
+    size_t counts[] = {1,2,4,8};
+    snmp::Metrics metrics;
+    for(size_t workers : counts)
+    {
+        snmp::AgentServer server(mib,"public",udp::endpoint(boost::asio::ip::address_v4::loopback(),0),workers);
+        server.start();
+        std::atomic<bool> running(true);
+        std::atomic<std::uint64_t> answered(0);
+        std::vector<std::thread> threads;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(size_t i = 0;i < clients;i++)
+            threads.push_back(std::thread(client,server.getEndpoint(),std::cref(request),std::cref(running),std::ref(answered)));
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        running = false;
+        for(std::thread& t : threads)
+            t.join();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        server.stop();
+        std::cout << std::setw(8) << workers << std::setw(14) << std::fixed << std::setprecision(0) << answered / elapsed << std::setw(10) << server.getDropped() << std::endl;
+        metrics.merge(server.getMetrics());
+    }
+    std::cout << std::endl;
+    metrics.dump(std::cout);
+    return 0;
+}
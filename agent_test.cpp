@@ -18,85 +18,42 @@
 #include <iostream>
 #include <boost/asio.hpp>
 #include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
 #include "snmp.h"
+#include "mib.h"
+#include "server.h"
+#include "cache.h"
 
 
 using boost::asio::ip::udp;
 
-enum { max_length = 1024 };
-
 size_t num_inter(0);
 
-std::uint32_t sysUpTime[] = {1,3,6,1,2,1,1,3,0};
-std::uint32_t sysDescr[] = {1,3,6,1,2,1,1,1,0};
-
-void recv(const snmp::Message& m,snmp::Message& sm)
-{
-    std::cout << "MessageType=" << (unsigned)m.getType() << "h,Len=" << std::dec <<  m.getLength() << ",Version=" << m.getVersion().getValue()
-        << ",Community=" << m.getCommunity().getValue() << ",RequestID=" << std::hex << m.getPDU().getRequestID().getValue() << std::dec << ",Error=" << m.getPDU().getError().getValue() << ",ErrorID=" << m.getPDU().getErrorID().getValue()<< std::endl;
-    if(m.getPDU().getError().getValue() > 0)
-    {
-    }
-    else
-    {
-        snmp::Message send_m(snmp::v1,"public");
-        snmp::Varbinds send_v;
-
-        const std::list<snmp::Varbind>& l = m.getPDU().getVarbinds().getValue();
-        for(std::list<snmp::Varbind>::const_iterator i = l.begin();i != l.end();i++)
-        {
-            const snmp::Varbind& rvar = *i;
-            std::cout << "OID=" << rvar.getOid().asString() << std::endl;
-            if(rvar.getValueType() == snmp::Primitive::tnull)
-            {
-                if(snmp::Oid(sysUpTime, sizeof(sysUpTime) / sizeof(std::uint32_t)) == rvar.getOid())
-                    send_v.addVarbind(snmp::Varbind(rvar.getOid(),snmp::TimeTicks(11111)));
-                else if(snmp::Oid(sysDescr, sizeof(sysDescr) / sizeof(std::uint32_t)) == rvar.getOid())
-                    send_v.addVarbind(snmp::Varbind(rvar.getOid(),snmp::OctetString("Test agenta SNMP")));
-                else
-                {
-                    send_v.addVarbind(snmp::Varbind(rvar.getOid()));
-                    snmp::PDU send_pdu(snmp::Complex::get_response,snmp::Integer(m.getPDU().getRequestID().getValue()),2,std::distance(l.begin(),i),send_v);
-                    send_m.setPDU(send_pdu);
-                    sm = send_m;
-                    return;
-                }
-            }
-        }
-        snmp::PDU send_pdu(snmp::Complex::get_response,snmp::Integer(m.getPDU().getRequestID().getValue()),0,0,send_v);
-        send_m.setPDU(send_pdu);
-        sm = send_m;
-    }
-}
+typedef snmp::oid<1,3,6,1,2,1,1,3,0> sysUpTime;
+typedef snmp::oid<1,3,6,1,2,1,1,1,0> sysDescr;
 
+snmp::MibRegistry mib;
+snmp::ValueCache cache(std::chrono::seconds(5));
 
 int main(int argc,char* argv[])
 {
 
     try
     {
-        boost::asio::io_service io_service;
-
-        udp::socket s(io_service, udp::endpoint(udp::v4(), 2001));
+        mib.addScalar(sysUpTime::get(),[](const snmp::Oid& oid) { return snmp::Varbind(oid,snmp::TimeTicks(11111)); });
+        mib.addScalar(sysDescr::get(),cache.cached([](const snmp::Oid& oid) { return snmp::Varbind(oid,snmp::OctetString("Test agenta SNMP")); }));
 
-        
-        udp::endpoint manager;
-        std::vector<unsigned char> request(max_length);
+        // Optional argument: number of worker threads.
+        size_t workers = argc > 1 ? std::strtoul(argv[1],0,10) : 1;
+        snmp::AgentServer server(mib,"public",udp::endpoint(udp::v4(), 2001),workers > 0 ? workers : 1);
+        server.start();
+        std::cout << "Listening on port " << server.getEndpoint().port() << " with " << server.getWorkers() << " workers" << std::endl;
         while(true)
         {
-            size_t r_length = s.receive_from(boost::asio::buffer(request),manager);
-            std::cout << "Manager : " << manager.address().to_string() << " Port: " <<  manager.port() << std::endl;
-            for(size_t i =0;i < r_length;i++)
-            {
-                std::cout << std::hex << (unsigned)request[i] << ' ';
-            }
-            std::cout << std::endl;
-            snmp::Message m,send_m;
-            m.read(request.begin(),request.begin()+r_length);
-            recv(m,send_m);
-            std::vector<std::uint8_t> to_send;
-            send_m.write(to_send);
-            s.send_to(boost::asio::buffer(to_send),manager);
+            std::this_thread::sleep_for(std::chrono::seconds(10));
+            std::cout << "Requests: " << server.getRequests() << " Dropped: " << server.getDropped() << std::endl;
         }
         return 0;
     }
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include "cache.h"
+
+namespace snmp
+{
+    namespace
+    {
+        class CachedHandler : public MibHandler
+        {
+        public:
+            CachedHandler(ValueCache& c,std::shared_ptr<MibHandler> h) : cache(c), handler(h) {}
+            bool get(const Oid& oid,Varbind& vb)
+            {
+                return cache.get(oid,false,vb,[&](Varbind& r) { return handler->get(oid,r); });
+            }
+            bool getNext(const Oid& oid,Varbind& vb)
+            {
+                return cache.get(oid,true,vb,[&](Varbind& r) { return handler->getNext(oid,r); });
+            }
+        private:
+            ValueCache& cache;
+            std::shared_ptr<MibHandler> handler;
+        };
+
+        bool isPrefix(const Oid& prefix,const Oid& oid)
+        {
+            return prefix.getValueSize() <= oid.getValueSize() && std::equal(prefix.getValue(),prefix.getValue() + prefix.getValueSize(),oid.getValue());
+        }
+    }
+
+    ValueCache::ValueCache(Clock::duration _default_ttl) : default_ttl(_default_ttl), hits(0), misses(0), coalesced(0)
+    {
+        std::unique_ptr<TTLs> t(new TTLs());
+        t->any = default_ttl > Clock::duration::zero();
+        ttls.store(t.get(),std::memory_order_release);
+        ttl_tables.push_back(std::move(t));
+    }
+
+    void ValueCache::setTTL(const Oid& prefix,Clock::duration t)
+    {
+        std::lock_guard<std::mutex> lock(ttl_mutex);
+        std::unique_ptr<TTLs> table(new TTLs(*ttls.load(std::memory_order_relaxed)));
+        std::vector<std::pair<Oid,Clock::duration>>::iterator it = table->prefixes.begin();
+        while(it != table->prefixes.end() && !(it->first == prefix))
+            it++;
+        if(it != table->prefixes.end())
+            it->second = t;
+        else
+            table->prefixes.push_back(std::make_pair(prefix,t));
+        table->any = default_ttl > Clock::duration::zero();
+        for(const std::pair<Oid,Clock::duration>& p : table->prefixes)
+            table->any = table->any || p.second > Clock::duration::zero();
+        ttls.store(table.get(),std::memory_order_release);
+        ttl_tables.push_back(std::move(table));
+    }
+
+    ValueCache::Clock::duration ValueCache::ttl(const TTLs& table,const Oid& oid) const
+    {
+        Clock::duration t = default_ttl;
+        size_t longest = 0;
+        for(const std::pair<Oid,Clock::duration>& p : table.prefixes)
+        {
+            if(p.first.getValueSize() >= longest && isPrefix(p.first,oid))
+            {
+                longest = p.first.getValueSize();
+                t = p.second;
+            }
+        }
+        return t;
+    }
+
+    MibRegistry::Getter ValueCache::cached(MibRegistry::Getter getter)
+    {
+        return [this,getter](const Oid& oid)
+        {
+            Varbind vb;
+            get(oid,false,vb,[&](Varbind& r) { r = getter(oid); return true; });
+            return vb;
+        };
+    }
+
+    std::shared_ptr<MibHandler> ValueCache::cached(std::shared_ptr<MibHandler> handler)
+    {
+        return std::make_shared<CachedHandler>(*this,handler);
+    }
+
+    void ValueCache::clear()
+    {
+        for(Shard& s : shards)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            // Entries being loaded stay, their loaders still refer to them.
+            for(std::unordered_map<Oid,Entry>* m : { &s.values,&s.next_values })
+            {
+                for(std::unordered_map<Oid,Entry>::iterator i = m->begin();i != m->end();)
+                    i = i->second.loading || i->second.waiters > 0 ? std::next(i) : m->erase(i);
+            }
+        }
+    }
+
+    bool ValueCache::get(const Oid& oid,bool next,Varbind& vb,const Fetch& fetch)
+    {
+        // Values that are not cached go straight to the provider. The time
+        // to live of a GetNext answer depends on the oid it finds, so that
+        // is known in advance only when nothing is cached at all.
+        const TTLs& table = *ttls.load(std::memory_order_acquire);
+        if(!table.any || (!next && ttl(table,oid) == Clock::duration::zero()))
+            return fetch(vb);
+
+        Shard& s = shards[oid.hash() % shard_count];
+        std::unordered_map<Oid,Entry>& values = next ? s.next_values : s.values;
+        std::unique_lock<std::mutex> lock(s.mutex);
+        std::unordered_map<Oid,Entry>::iterator i = values.find(oid);
+        if(i != values.end())
+        {
+            bool waited = i->second.loading;
+            if(waited)
+            {
+                coalesced.fetch_add(1,std::memory_order_relaxed);
+                i->second.waiters++;
+                s.loaded.wait(lock,[&]() { i = values.find(oid); return i == values.end() || !i->second.loading; });
+            }
+            // Waiters take what the load found even if it is not cached.
+            if(i != values.end() && (Clock::now() < i->second.expires || waited))
+            {
+                hits.fetch_add(1,std::memory_order_relaxed);
+                bool found = i->second.found;
+                if(found)
+                    vb = i->second.vb;
+                if(waited && --i->second.waiters == 0 && i->second.expires <= Clock::now())
+                    values.erase(i);
+                return found;
+            }
+        }
+        misses.fetch_add(1,std::memory_order_relaxed);
+        // Marked as loading, so that concurrent misses wait for this fetch.
+        // Threads still to take an uncached value now wait for this one.
+        Entry& loading = values[oid];
+        std::uint32_t waiters = loading.waiters;
+        loading = Entry();
+        loading.waiters = waiters;
+        lock.unlock();
+
+        Entry entry;
+        try
+        {
+            entry.found = fetch(entry.vb);
+        }
+        catch(...)
+        {
+            // Waiters find no entry and fetch for themselves.
+            lock.lock();
+            values.erase(oid);
+            s.loaded.notify_all();
+            throw;
+        }
+        entry.loading = false;
+        Clock::duration t = ttl(table,entry.found ? entry.vb.getOid() : oid);
+        entry.expires = Clock::now() + t;
+        // Encoded once for all the hits to come, if there are to be any.
+        if(entry.found && t > Clock::duration::zero())
+        {
+            std::vector<std::uint8_t> buffer(entry.vb.getSize());
+            Encoder enc(buffer.data(),buffer.size());
+            enc.writeValue(entry.vb);
+            entry.vb.setEncodedValue(std::make_shared<const std::vector<std::uint8_t>>(enc.data(),enc.data() + enc.size()));
+        }
+        if(entry.found)
+            vb = entry.vb;
+
+        bool found = entry.found;
+        lock.lock();
+        i = values.find(oid);
+        entry.waiters = i->second.waiters;
+        if(t > Clock::duration::zero() || entry.waiters > 0)
+        {
+            i->second = std::move(entry);
+            if(values.size() > max_entries)
+                sweep(values);
+        }
+        else
+            values.erase(i);
+        s.loaded.notify_all();
+        return found;
+    }
+
+    // Drops expired entries, and everything that is not being loaded if that
+    // is not enough. GetNext entries are keyed by whatever oids managers ask
+    // for, so the maps would otherwise only grow.
+    void ValueCache::sweep(std::unordered_map<Oid,Entry>& values)
+    {
+        Clock::time_point now = Clock::now();
+        for(std::unordered_map<Oid,Entry>::iterator i = values.begin();i != values.end();)
+            i = !i->second.loading && i->second.waiters == 0 && i->second.expires <= now ? values.erase(i) : std::next(i);
+        if(values.size() > max_entries / 2)
+        {
+            for(std::unordered_map<Oid,Entry>::iterator i = values.begin();i != values.end();)
+                i = i->second.loading || i->second.waiters > 0 ? std::next(i) : values.erase(i);
+        }
+    }
+}
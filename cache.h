@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include "snmp.h"
+#include "mib.h"
+
+namespace snmp
+{
+    // Cache in front of slow value providers. Values are kept for a time to
+    // live chosen by the longest registered prefix of their oid, already
+    // encoded, so a hit costs neither the provider nor the encoder. When
+    // several threads miss on the same oid only one of them asks the
+    // provider; the others wait for its answer. Safe to share between
+    // threads; it must outlive the getters and handlers made by cached().
+    class ValueCache
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+        // Values under no registered prefix are kept for default_ttl; zero
+        // means they are not cached.
+        explicit ValueCache(Clock::duration default_ttl = Clock::duration::zero());
+        ValueCache(const ValueCache&) = delete;
+        ValueCache& operator=(const ValueCache&) = delete;
+        // Time to live for prefix and everything under it.
+        void setTTL(const Oid& prefix,Clock::duration ttl);
+        // Wrap providers for MibRegistry::addScalar and addSubtree.
+        MibRegistry::Getter cached(MibRegistry::Getter getter);
+        std::shared_ptr<MibHandler> cached(std::shared_ptr<MibHandler> handler);
+        typedef std::function<bool(Varbind&)> Fetch;
+        // Value of oid (of the instance after oid if next is set), from the
+        // cache or else from fetch(vb), whose answer is cached, false
+        // included.
+        bool get(const Oid& oid,bool next,Varbind& vb,const Fetch& fetch);
+        void clear();
+        // Values whose time to live is zero count as neither hits nor
+        // misses, except for GetNext answers.
+        std::uint64_t getHits() const { return hits.load(std::memory_order_relaxed); }
+        std::uint64_t getMisses() const { return misses.load(std::memory_order_relaxed); }
+        // Misses that waited for another thread's fetch instead of their own.
+        std::uint64_t getCoalesced() const { return coalesced.load(std::memory_order_relaxed); }
+    private:
+        enum { shard_count = 16, max_entries = 4096 }; // per shard and map
+        struct Entry
+        {
+            Entry() : found(false), loading(true), waiters(0) {}
+            Varbind vb;
+            bool found;
+            bool loading;
+            // Threads waiting for the load; an uncached value is kept for
+            // them until the last one has taken it.
+            std::uint32_t waiters;
+            Clock::time_point expires;
+        };
+        struct Shard
+        {
+            std::mutex mutex;
+            std::condition_variable loaded;
+            std::unordered_map<Oid,Entry> values;
+            std::unordered_map<Oid,Entry> next_values;
+        };
+        // Read without locking: setTTL publishes a new table and keeps the
+        // old ones, which readers may still hold, until destruction.
+        struct TTLs
+        {
+            std::vector<std::pair<Oid,Clock::duration>> prefixes;
+            // Whether any value is cached at all.
+            bool any;
+        };
+        Clock::duration ttl(const TTLs& t,const Oid& oid) const;
+        void sweep(std::unordered_map<Oid,Entry>& values);
+        Clock::duration default_ttl;
+        std::mutex ttl_mutex;
+        std::vector<std::unique_ptr<const TTLs>> ttl_tables;
+        std::atomic<const TTLs*> ttls;
+        Shard shards[shard_count];
+        std::atomic<std::uint64_t> hits;
+        std::atomic<std::uint64_t> misses;
+        std::atomic<std::uint64_t> coalesced;
+    };
+}
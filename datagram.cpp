@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "datagram.h"
+
+namespace snmp
+{
+    DatagramBatch::DatagramBatch(size_t n,size_t size) : slot_size(size), count(0), storage(n * size), slots(n), endpoints(n)
+    {
+#if defined(__linux__)
+        headers.resize(n);
+        for(size_t i = 0;i < n;i++)
+        {
+            std::memset(&headers[i],0,sizeof(struct mmsghdr));
+            headers[i].msg_hdr.msg_iov = &slots[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+#endif
+    }
+
+    void DatagramBatch::push(size_t length,const boost::asio::ip::udp::endpoint& ep)
+    {
+        push(&storage[count * slot_size],length,ep);
+    }
+
+    void DatagramBatch::push(const std::uint8_t* data,size_t length,const boost::asio::ip::udp::endpoint& ep)
+    {
+        slots[count].iov_base = const_cast<std::uint8_t*>(data);
+        slots[count].iov_len = length;
+        endpoints[count] = ep;
+        count++;
+    }
+
+    static boost::system::error_code lastError()
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+            return boost::asio::error::would_block;
+        return boost::system::error_code(errno,boost::system::system_category());
+    }
+
+#if defined(__linux__)
+    size_t DatagramBatch::receive(int fd,bool wait,boost::system::error_code& ec)
+    {
+        count = 0;
+        for(size_t i = 0;i < slots.size();i++)
+        {
+            slots[i].iov_base = &storage[i * slot_size];
+            slots[i].iov_len = slot_size;
+            headers[i].msg_hdr.msg_name = endpoints[i].data();
+            headers[i].msg_hdr.msg_namelen = endpoints[i].capacity();
+        }
+        int n;
+        do
+        {
+            n = ::recvmmsg(fd,headers.data(),slots.size(),wait ? MSG_WAITFORONE : MSG_DONTWAIT,0);
+        }
+        while(n < 0 && errno == EINTR);
+        if(n < 0)
+        {
+            ec = lastError();
+            return 0;
+        }
+        ec = boost::system::error_code();
+        for(int i = 0;i < n;i++)
+        {
+            endpoints[i].resize(headers[i].msg_hdr.msg_namelen);
+            slots[i].iov_len = std::min<size_t>(headers[i].msg_len,slot_size);
+        }
+        count = n;
+        return count;
+    }
+
+    size_t DatagramBatch::send(int fd,size_t first,boost::system::error_code& ec)
+    {
+        for(size_t i = first;i < count;i++)
+        {
+            headers[i].msg_hdr.msg_name = const_cast<boost::asio::ip::udp::endpoint&>(endpoints[i]).data();
+            headers[i].msg_hdr.msg_namelen = endpoints[i].size();
+        }
+        ec = boost::system::error_code();
+        size_t sent = 0;
+        while(first + sent < count)
+        {
+            int n = ::sendmmsg(fd,&headers[first + sent],count - first - sent,0);
+            if(n < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                ec = lastError();
+                break;
+            }
+            sent += n;
+        }
+        return sent;
+    }
+#else
+    size_t DatagramBatch::receive(int fd,bool wait,boost::system::error_code& ec)
+    {
+        count = 0;
+        ec = boost::system::error_code();
+        for(size_t i = 0;i < slots.size();i++)
+        {
+            socklen_t len = endpoints[i].capacity();
+            ssize_t n = ::recvfrom(fd,&storage[i * slot_size],slot_size,wait && i == 0 ? 0 : MSG_DONTWAIT,endpoints[i].data(),&len);
+            if(n < 0)
+            {
+                if(errno == EINTR)
+                {
+                    i--;
+                    continue;
+                }
+                if(i == 0)
+                    ec = lastError();
+                break;
+            }
+            endpoints[i].resize(len);
+            slots[i].iov_base = &storage[i * slot_size];
+            slots[i].iov_len = n;
+            count++;
+        }
+        return count;
+    }
+
+    size_t DatagramBatch::send(int fd,size_t first,boost::system::error_code& ec)
+    {
+        ec = boost::system::error_code();
+        size_t sent = 0;
+        while(first + sent < count)
+        {
+            size_t i = first + sent;
+            if(::sendto(fd,slots[i].iov_base,slots[i].iov_len,0,endpoints[i].data(),endpoints[i].size()) < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                ec = lastError();
+                break;
+            }
+            sent++;
+        }
+        return sent;
+    }
+#endif
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <boost/asio.hpp>
+
+namespace snmp
+{
+    // Fixed set of datagram slots moved in and out of a UDP socket with one
+    // recvmmsg/sendmmsg call per batch (a loop of recvfrom/sendto where
+    // those are not available). All storage is allocated up front; a batch is
+    // meant to be reused for the life of the socket.
+    class DatagramBatch
+    {
+    public:
+        DatagramBatch(size_t count,size_t size);
+        DatagramBatch(const DatagramBatch&) = delete;
+        DatagramBatch& operator=(const DatagramBatch&) = delete;
+        size_t capacity() const { return slots.size(); }
+        size_t size() const { return count; }
+        bool full() const { return count == slots.size(); }
+        void clear() { count = 0; }
+        // Slot i after receive(), or as queued by push().
+        const std::uint8_t* data(size_t i) const { return static_cast<const std::uint8_t*>(slots[i].iov_base); }
+        size_t length(size_t i) const { return slots[i].iov_len; }
+        const boost::asio::ip::udp::endpoint& endpoint(size_t i) const { return endpoints[i]; }
+        // Storage of the next free slot, to encode a datagram in place before
+        // push(length,ep).
+        std::uint8_t* buffer() { return &storage[count * slot_size]; }
+        size_t bufferSize() const { return slot_size; }
+        void push(size_t length,const boost::asio::ip::udp::endpoint& ep);
+        // Queues a datagram kept elsewhere; it must stay valid until sent.
+        void push(const std::uint8_t* data,size_t length,const boost::asio::ip::udp::endpoint& ep);
+        // Replaces the contents with the datagrams waiting on fd. With wait
+        // set it blocks for the first one, otherwise it returns 0 and
+        // would_block if there are none. Datagrams longer than the slot
+        // size are truncated.
+        size_t receive(int fd,bool wait,boost::system::error_code& ec);
+        // Sends the queued datagrams from first on and returns how many went
+        // out. If one fails, ec is set and it is not counted; the caller may
+        // skip it and call again.
+        size_t send(int fd,size_t first,boost::system::error_code& ec);
+    private:
+        size_t slot_size;
+        size_t count;
+        std::vector<std::uint8_t> storage;
+        std::vector<struct iovec> slots;
+        std::vector<boost::asio::ip::udp::endpoint> endpoints;
+#if defined(__linux__)
+        std::vector<struct mmsghdr> headers;
+#endif
+    };
+}
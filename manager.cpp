@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <random>
+#include "manager.h"
+
+namespace snmp
+{
+    Manager::Manager(boost::asio::io_service& io,const boost::asio::ip::udp::endpoint& local) :
+        socket(io,local), timer(io), epoch(std::chrono::steady_clock::now()), resolution(10), timeout(1000), retries(1),
+        wheel(wheel_slots), current(0), timer_running(false), receive_running(false), encoder(std::pmr::get_default_resource(),512,max_datagram),
+        flush_scheduled(false), in(batch_size,65535), out(batch_size,0), arena_buffer(16384), metrics(0)
+    {
+        boost::system::error_code ec;
+        // Thousands of agents may answer at once.
+        socket.set_option(boost::asio::socket_base::receive_buffer_size(4 * 1024 * 1024),ec);
+        std::random_device rd;
+        last_id = rd() & 0x7fffffff;
+    }
+
+    Manager::~Manager()
+    {
+        boost::system::error_code ec;
+        timer.cancel(ec);
+        socket.close(ec);
+    }
+
+    std::int32_t Manager::get(const Target& target,const Varbinds& vbs,Callback cb)
+    {
+        return send(target,Complex::get_request,0,0,vbs,std::move(cb));
+    }
+
+    std::int32_t Manager::getNext(const Target& target,const Varbinds& vbs,Callback cb)
+    {
+        return send(target,Complex::get_next_request,0,0,vbs,std::move(cb));
+    }
+
+    std::int32_t Manager::getBulk(const Target& target,std::int32_t non_repeaters,std::int32_t max_repetitions,const Varbinds& vbs,Callback cb)
+    {
+        return send(target,Complex::get_bulk_request,non_repeaters,max_repetitions,vbs,std::move(cb));
+    }
+
+    std::int32_t Manager::nextRequestID()
+    {
+        do
+        {
+            last_id = last_id == 0x7fffffff ? 1 : last_id + 1;
+        }
+        while(pending.count(last_id) != 0);
+        return last_id;
+    }
+
+    std::int32_t Manager::send(const Target& target,Complex::Type type,std::int32_t error,std::int32_t error_id,const Varbinds& vbs,Callback cb)
+    {
+        std::int32_t id = nextRequestID();
+        std::uint64_t start = metrics ? Metrics::now() : 0;
+        encoder.reset();
+        size_t m = encoder.mark();
+        size_t p = encoder.mark();
+        encoder.write(vbs);
+        encoder.writeInteger(error_id);
+        encoder.writeInteger(error);
+        encoder.writeInteger(id);
+        encoder.close(type,p);
+        encoder.writeOctetString(target.community);
+        encoder.writeInteger(target.version);
+        encoder.close(Complex::sequence,m);
+        if(metrics)
+        {
+            metrics->lap(Metrics::encode,start);
+            metrics->encoded(type);
+        }
+
+        if(pending.empty())
+            current = now();
+        Request& r = pending[id];
+        r.endpoint = target.endpoint;
+        r.datagram.assign(encoder.data(),encoder.data() + encoder.size());
+        r.callback = std::move(cb);
+        r.retries = retries;
+        r.sent = 0;
+        transmit(id,r);
+        startReceive();
+        return id;
+    }
+
+    // Datagrams are queued and sent together with sendmmsg once the handler
+    // that queued them returns, so send() never calls back into the caller.
+    void Manager::transmit(std::int32_t id,Request& r)
+    {
+        queued.push_back(id);
+        if(!flush_scheduled)
+        {
+            flush_scheduled = true;
+            boost::asio::post(socket.get_executor(),[this]() { flush(); });
+        }
+        schedule(id,r);
+    }
+
+    void Manager::flush()
+    {
+        flush_scheduled = false;
+        std::vector<std::pair<std::int32_t,boost::system::error_code>> failed;
+        size_t next = 0;
+        bool blocked = false;
+        while(next < queued.size() && !blocked)
+        {
+            out.clear();
+            batch.clear();
+            for(;next < queued.size() && !out.full();next++)
+            {
+                std::unordered_map<std::int32_t,Request>::iterator i = pending.find(queued[next]);
+                if(i == pending.end())
+                    continue;
+                out.push(i->second.datagram.data(),i->second.datagram.size(),i->second.endpoint);
+                batch.push_back(queued[next]);
+            }
+            if(metrics)
+            {
+                // Stamped before sending so that no answer can beat it.
+                std::uint64_t t = Metrics::now();
+                for(std::int32_t id : batch)
+                {
+                    Request& r = pending.find(id)->second;
+                    r.sent = r.retries == retries ? t : 0;
+                }
+            }
+            size_t sent = 0;
+            while(sent < out.size())
+            {
+                boost::system::error_code ec;
+                sent += out.send(socket.native_handle(),sent,ec);
+                if(ec == boost::asio::error::would_block)
+                {
+                    // The send buffer is full: what is left waits for room,
+                    // in order, ahead of anything queued meanwhile.
+                    queued.erase(queued.begin(),queued.begin() + next);
+                    queued.insert(queued.begin(),batch.begin() + sent,batch.end());
+                    blocked = true;
+                    break;
+                }
+                if(ec)
+                {
+                    failed.push_back(std::make_pair(batch[sent],ec));
+                    sent++;
+                }
+            }
+        }
+        if(blocked)
+        {
+            // Also keeps transmit() from scheduling flushes until then.
+            flush_scheduled = true;
+            socket.async_wait(boost::asio::ip::udp::socket::wait_write,[this](const boost::system::error_code& ec) {
+                if(ec != boost::asio::error::operation_aborted)
+                    flush();
+                else
+                {
+                    // stopIfIdle() cancels this wait along with the receive;
+                    // whatever is still queued is tried again rather than
+                    // left behind a flush that never comes.
+                    flush_scheduled = false;
+                    if(!queued.empty())
+                    {
+                        flush_scheduled = true;
+                        boost::asio::post(socket.get_executor(),[this]() { flush(); });
+                    }
+                }
+            });
+        }
+        else
+            queued.clear();
+        // Only now, as callbacks may drop requests whose datagrams were queued.
+        for(size_t f = 0;f < failed.size();f++)
+        {
+            std::unordered_map<std::int32_t,Request>::iterator i = pending.find(failed[f].first);
+            if(i != pending.end())
+                complete(i,failed[f].second,Message());
+        }
+    }
+
+    void Manager::schedule(std::int32_t id,Request& r)
+    {
+        std::uint64_t ticks = (timeout + resolution - std::chrono::milliseconds(1)) / resolution;
+        r.expires = current + std::max<std::uint64_t>(ticks,1);
+        wheel[r.expires % wheel_slots].push_back(id);
+        startTimer();
+    }
+
+    void Manager::complete(std::unordered_map<std::int32_t,Request>::iterator i,const boost::system::error_code& ec,const Message& m)
+    {
+        // The callback may send or cancel requests, so the entry goes first.
+        Callback cb = std::move(i->second.callback);
+        pending.erase(i);
+        stopIfIdle();
+        cb(ec,m);
+    }
+
+    bool Manager::cancel(std::int32_t request_id)
+    {
+        std::unordered_map<std::int32_t,Request>::iterator i = pending.find(request_id);
+        if(i == pending.end())
+            return false;
+        complete(i,boost::asio::error::operation_aborted,Message());
+        return true;
+    }
+
+    void Manager::cancelAll()
+    {
+        std::unordered_map<std::int32_t,Request> requests;
+        requests.swap(pending);
+        for(std::vector<std::int32_t>& slot : wheel)
+            slot.clear();
+        stopIfIdle();
+        Message empty;
+        for(std::pair<const std::int32_t,Request>& r : requests)
+            r.second.callback(boost::asio::error::operation_aborted,empty);
+    }
+
+    // Receiving and the timer only run while requests are pending, so that
+    // io_service::run() returns once every request has completed.
+    void Manager::startReceive()
+    {
+        if(receive_running || pending.empty())
+            return;
+        receive_running = true;
+        socket.async_wait(boost::asio::ip::udp::socket::wait_read,[this](const boost::system::error_code& ec) { received(ec); });
+    }
+
+    void Manager::received(const boost::system::error_code& ec)
+    {
+        receive_running = false;
+        if(!ec)
+        {
+            boost::system::error_code rec;
+            size_t n = in.receive(socket.native_handle(),false,rec);
+            for(size_t k = 0;k < n;k++)
+            {
+                std::uint64_t start = metrics ? Metrics::now() : 0;
+                std::pmr::monotonic_buffer_resource arena(arena_buffer.data(),arena_buffer.size());
+                Message m(&arena);
+                Status status;
+                if(m.read(in.data(k),in.data(k) + in.length(k),status) != 0 && m.getPDU().getType() == Complex::get_response)
+                {
+                    std::unordered_map<std::int32_t,Request>::iterator i = pending.find(m.getPDU().getRequestID().getValue());
+                    if(i != pending.end() && i->second.endpoint == in.endpoint(k))
+                    {
+                        if(metrics)
+                        {
+                            metrics->decoded(m.getPDUType());
+                            if(i->second.sent != 0)
+                                metrics->record(Metrics::rtt,start - i->second.sent);
+                            start = metrics->lap(Metrics::decode,start);
+                        }
+                        complete(i,rec,m);
+                        if(metrics)
+                            metrics->lap(Metrics::handler,start);
+                        continue;
+                    }
+                }
+                else if(metrics && !status.ok())
+                    metrics->failed(status.code);
+                // Malformed, not a response, or answering nothing pending.
+                if(metrics)
+                    metrics->add(Metrics::dropped);
+            }
+        }
+        startReceive();
+    }
+
+    void Manager::stopIfIdle()
+    {
+        boost::system::error_code ec;
+        if(pending.empty() && receive_running)
+            socket.cancel(ec);
+    }
+
+    std::uint64_t Manager::now() const
+    {
+        return (std::chrono::steady_clock::now() - epoch) / resolution;
+    }
+
+    void Manager::startTimer()
+    {
+        if(timer_running || pending.empty())
+            return;
+        timer_running = true;
+        timer.expires_at(epoch + (current + 1) * resolution);
+        timer.async_wait([this](const boost::system::error_code& ec) { tick(ec); });
+    }
+
+    void Manager::tick(const boost::system::error_code& ec)
+    {
+        timer_running = false;
+        if(ec == boost::asio::error::operation_aborted)
+            return;
+        std::uint64_t t = now();
+        std::vector<std::int32_t> expired;
+        while(current < t)
+        {
+            current++;
+            std::vector<std::int32_t>& slot = wheel[current % wheel_slots];
+            expired.clear();
+            expired.swap(slot);
+            for(std::int32_t id : expired)
+            {
+                std::unordered_map<std::int32_t,Request>::iterator i = pending.find(id);
+                if(i == pending.end())
+                    continue;
+                Request& r = i->second;
+                if(r.expires > current)
+                {
+                    // A later turn of the wheel, unless it is an old entry of
+                    // a request rescheduled to another slot.
+                    if(r.expires % wheel_slots == current % wheel_slots)
+                        slot.push_back(id);
+                }
+                else if(r.expires == current)
+                {
+                    if(r.retries > 0)
+                    {
+                        r.retries--;
+                        if(metrics)
+                            metrics->add(Metrics::retries);
+                        transmit(id,r);
+                    }
+                    else
+                    {
+                        if(metrics)
+                            metrics->add(Metrics::timeouts);
+                        complete(i,boost::asio::error::timed_out,Message());
+                    }
+                }
+            }
+        }
+        startTimer();
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <vector>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <chrono>
+#include <memory_resource>
+#include <boost/asio.hpp>
+#include "snmp.h"
+#include "datagram.h"
+#include "metrics.h"
+
+namespace snmp
+{
+    // Asynchronous SNMPv1/v2c manager: any number of requests to any number of
+    // agents are kept outstanding over one UDP socket. Responses are matched
+    // by request-id, timeouts are driven by a timer wheel and each request
+    // completes exactly once through its callback. All members must be called
+    // from the thread running the io_service, and the Manager must outlive
+    // the handlers it has queued there.
+    class Manager
+    {
+    public:
+        struct Target
+        {
+            Target() : version(v2c), community("public") {}
+            Target(const boost::asio::ip::udp::endpoint& ep,int ver,const std::string& comm) : endpoint(ep), version(ver), community(comm) {}
+            boost::asio::ip::udp::endpoint endpoint;
+            int version;
+            std::string community;
+        };
+        // Called with an empty error code and the response, or with
+        // boost::asio::error::timed_out / operation_aborted or the send
+        // error and an empty message. The message is only valid during the
+        // call.
+        typedef std::function<void(const boost::system::error_code&,const Message&)> Callback;
+
+        explicit Manager(boost::asio::io_service& io,const boost::asio::ip::udp::endpoint& local = boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(),0));
+        Manager(const Manager&) = delete;
+        Manager& operator=(const Manager&) = delete;
+        ~Manager();
+        // Time to wait for each attempt and the number of resends after the
+        // first one. Apply to requests sent afterwards.
+        void setTimeout(std::chrono::milliseconds t) { timeout = t; }
+        void setRetries(unsigned n) { retries = n; }
+        // Where to count requests and time them; 0, the default, records
+        // nothing. Only the io_service thread may write to it.
+        void setMetrics(Metrics* m) { metrics = m; }
+        std::int32_t get(const Target& target,const Varbinds& vbs,Callback cb);
+        std::int32_t getNext(const Target& target,const Varbinds& vbs,Callback cb);
+        std::int32_t getBulk(const Target& target,std::int32_t non_repeaters,std::int32_t max_repetitions,const Varbinds& vbs,Callback cb);
+        // Sends a request PDU of any type; returns its request-id. Throws
+        // Except::too_big if the request does not fit in a UDP datagram.
+        std::int32_t send(const Target& target,Complex::Type type,std::int32_t error,std::int32_t error_id,const Varbinds& vbs,Callback cb);
+        // Completes the request with operation_aborted; false if it is no
+        // longer pending.
+        bool cancel(std::int32_t request_id);
+        void cancelAll();
+        size_t getPending() const { return pending.size(); }
+    private:
+        enum { wheel_slots = 1024, batch_size = 32, max_datagram = 65507 };
+        struct Request
+        {
+            boost::asio::ip::udp::endpoint endpoint;
+            std::vector<std::uint8_t> datagram;
+            Callback callback;
+            unsigned retries;
+            std::uint64_t expires;
+            // When the datagram went out, if it went out once only.
+            std::uint64_t sent;
+        };
+        std::int32_t nextRequestID();
+        void transmit(std::int32_t id,Request& r);
+        void schedule(std::int32_t id,Request& r);
+        void complete(std::unordered_map<std::int32_t,Request>::iterator i,const boost::system::error_code& ec,const Message& m);
+        void startReceive();
+        void stopIfIdle();
+        void received(const boost::system::error_code& ec);
+        void flush();
+        void startTimer();
+        void tick(const boost::system::error_code& ec);
+        std::uint64_t now() const;
+
+        boost::asio::ip::udp::socket socket;
+        boost::asio::steady_timer timer;
+        std::chrono::steady_clock::time_point epoch;
+        std::chrono::milliseconds resolution;
+        std::chrono::milliseconds timeout;
+        unsigned retries;
+        std::int32_t last_id;
+        std::unordered_map<std::int32_t,Request> pending;
+        // Slot i holds the ids expiring at ticks congruent to i. Entries are
+        // not removed when a response arrives; an entry whose request is gone
+        // or has been rescheduled is skipped when its slot comes up.
+        std::vector<std::vector<std::int32_t>> wheel;
+        std::uint64_t current;
+        bool timer_running;
+        bool receive_running;
+        Encoder encoder;
+        std::vector<std::int32_t> queued;
+        bool flush_scheduled;
+        DatagramBatch in;
+        DatagramBatch out;
+        std::vector<std::int32_t> batch;
+        std::vector<std::uint8_t> arena_buffer;
+        Metrics* metrics;
+    };
+}
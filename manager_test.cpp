@@ -18,7 +18,12 @@
 #include <iostream>
 #include <boost/asio.hpp>
 #include <vector>
+#include <cerrno>
+#include <cstring>
+#include <dlfcn.h>
+#include <sys/socket.h>
 #include "snmp.h"
+#include "manager.h"
 
 
 using boost::asio::ip::udp;
@@ -35,8 +40,8 @@ void recv(const snmp::Message& m)
     }
     else
     {
-        const std::list<snmp::Varbind>& l = m.getPDU().getVarbinds().getValue();
-        for(std::list<snmp::Varbind>::const_iterator i = l.begin();i != l.end();i++)
+        snmp::Span<snmp::Varbind> l = m.getPDU().getVarbinds().getValue();
+        for(snmp::Span<snmp::Varbind>::const_iterator i = l.begin();i != l.end();i++)
         {
             const snmp::Varbind& rvar = *i;
             std::cout << "OID=" << rvar.getOid().asString();
@@ -63,53 +68,100 @@ void recv(const snmp::Message& m)
             }
             else
             {
-                std::cout << ": Unknow,Type=" << std::hex << (unsigned)rvar.getUnknow().getType() << "h" << std::endl;
+                std::cout << ": Unknow,Type=" << std::hex << (unsigned)rvar.getValueType() << "h" << std::endl;
             }
         }
     }
 }
 
+// Loopback never fills a UDP send buffer, so the self test makes sendmmsg
+// report a full one while this is set.
+static bool send_buffer_full = false;
+
+extern "C" int sendmmsg(int fd,struct mmsghdr* headers,unsigned int n,int flags)
+{
+    typedef int (*Send)(int,struct mmsghdr*,unsigned int,int);
+    static Send next = reinterpret_cast<Send>(dlsym(RTLD_NEXT,"sendmmsg"));
+    if(send_buffer_full)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    return next(fd,headers,n,flags);
+}
+
+// A request is held back while the send buffer is full, cancelAll() then
+// aborts the wait for room, and a request made afterwards must still go
+// out.
+static int selfTest()
+{
+    boost::asio::io_service io_service;
+    udp::socket agent(io_service,udp::endpoint(boost::asio::ip::address_v4::loopback(),0));
+    snmp::Manager manager(io_service);
+    manager.setTimeout(std::chrono::milliseconds(2000));
+    manager.setRetries(0);
+    snmp::Manager::Target target(agent.local_endpoint(),snmp::v2c,"public");
+    snmp::Varbinds vbs;
+    vbs.addVarbind(snmp::Varbind(snmp::oid<1,3,6,1,2,1,1,3,0>::get()));
+    auto ignore = [](const boost::system::error_code&,const snmp::Message&) {};
+
+    send_buffer_full = true;
+    manager.get(target,vbs,ignore);
+    // Runs the flush, which finds no room and waits for some.
+    io_service.poll_one();
+    manager.cancelAll();
+    send_buffer_full = false;
+    std::int32_t id = manager.get(target,vbs,ignore);
+    io_service.run_for(std::chrono::milliseconds(200));
+
+    bool sent = false;
+    boost::system::error_code ec;
+    agent.non_blocking(true);
+    std::vector<std::uint8_t> data(max_length);
+    for(size_t n;(n = agent.receive(boost::asio::buffer(data),0,ec)) > 0 && !ec;)
+    {
+        snmp::Message m;
+        m.read(data.data(),data.data() + n);
+        sent |= m.getPDU().getRequestID().getValue() == id;
+    }
+    manager.cancelAll();
+    std::cout << "request after cancelAll() on a full send buffer: " << (sent ? "sent" : "not sent") << std::endl;
+    return sent ? 0 : 1;
+}
+
+// With host port pairs, polls each; with --self-test, checks the manager.
 int main(int argc,char* argv[])
 {
+    if(argc == 2 && std::strcmp(argv[1],"--self-test") == 0)
+        return selfTest();
 
     try
     {
         boost::asio::io_service io_service;
 
-        udp::socket s(io_service);
+        snmp::Manager manager(io_service);
         udp::resolver resolver(io_service);
-        udp::resolver::query query(udp::v4(), argv[1], argv[2]);
-        udp::resolver::iterator iterator = resolver.resolve(query);
-        s.connect(*iterator);
-        
-        using namespace std;
-
-        snmp::Message send_m(snmp::v1,"public");
 
-        std::uint32_t oid1[9] = {1,3,6,1,2,1,1,3,0};
-        std::uint32_t oid2[9] = {1,3,6,1,2,1,1,1,0};
         snmp::Varbinds vsystem;
-        vsystem.addVarbind(snmp::Varbind(snmp::Oid(oid1,sizeof(oid1) / sizeof(std::uint32_t))));
-        vsystem.addVarbind(snmp::Varbind(snmp::Oid(oid2,sizeof(oid2) / sizeof(std::uint32_t))));
-        //vsystem.addVarbind(snmp::Varbind(snmp::Oid(oid3,sizeof(oid3) / sizeof(std::uint32_t))));
-        //vsystem.addVarbind(snmp::Varbind(snmp::Oid(oid4,sizeof(oid4) / sizeof(std::uint32_t))));
-        //vsystem.addVarbind(snmp::Varbind(snmp::Oid(oid5,sizeof(oid5) / sizeof(std::uint32_t))));
-        //vsystem.addVarbind(snmp::Varbind(snmp::Oid(oid6,sizeof(oid6) / sizeof(std::uint32_t))));
-
-        
-        snmp::PDU pdu_system(snmp::Complex::get_request,0x11223344,0,0,vsystem);
-        send_m.setPDU(pdu_system);
-        std::vector<std::uint8_t> to_send;
-        send_m.write(to_send);
-        s.send(boost::asio::buffer(to_send));
-
-
-        std::vector<unsigned char> reply(max_length);
-//        udp::endpoint sender_endpoint;
-        size_t reply_length = s.receive(boost::asio::buffer(reply));
-        snmp::Message m;
-        m.read(reply.begin(),reply.begin()+reply_length);
-        recv(m);
+        vsystem.addVarbind(snmp::Varbind(snmp::oid<1,3,6,1,2,1,1,3,0>::get()));
+        vsystem.addVarbind(snmp::Varbind(snmp::oid<1,3,6,1,2,1,1,1,0>::get()));
+
+        // Every host port pair on the command line is polled at once.
+        for(int i = 1;i + 1 < argc;i += 2)
+        {
+            udp::resolver::query query(udp::v4(), argv[i], argv[i + 1]);
+            snmp::Manager::Target target(*resolver.resolve(query),snmp::v1,"public");
+            std::string name = std::string(argv[i]) + ':' + argv[i + 1];
+            manager.get(target,vsystem,[name](const boost::system::error_code& ec,const snmp::Message& m)
+            {
+                std::cout << name << std::endl;
+                if(ec)
+                    std::cout << "Failed: " << ec.message() << std::endl;
+                else
+                    recv(m);
+            });
+        }
+        io_service.run();
         return 0;
     }
     catch (std::exception& e)
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <chrono>
+#include <iomanip>
+#include "metrics.h"
+
+namespace snmp
+{
+    static void copy(std::atomic<std::uint64_t>* to,const std::atomic<std::uint64_t>* from,size_t n)
+    {
+        for(size_t i = 0;i < n;i++)
+            to[i].store(from[i].load(std::memory_order_relaxed),std::memory_order_relaxed);
+    }
+
+    static void accumulate(std::atomic<std::uint64_t>* to,const std::atomic<std::uint64_t>* from,size_t n)
+    {
+        for(size_t i = 0;i < n;i++)
+            to[i].store(to[i].load(std::memory_order_relaxed) + from[i].load(std::memory_order_relaxed),std::memory_order_relaxed);
+    }
+
+    Histogram::Histogram() : count(0), sum(0), max(0)
+    {
+        for(size_t i = 0;i < buckets;i++)
+            counts[i].store(0,std::memory_order_relaxed);
+    }
+
+    Histogram::Histogram(const Histogram& h)
+    {
+        *this = h;
+    }
+
+    Histogram& Histogram::operator=(const Histogram& h)
+    {
+        copy(counts,h.counts,buckets);
+        copy(&count,&h.count,1);
+        copy(&sum,&h.sum,1);
+        copy(&max,&h.max,1);
+        return *this;
+    }
+
+    // Below 2 * sub_buckets the buckets are exact; above, the bit length of
+    // the value picks a group of sub_buckets and the bits after the leading
+    // one the bucket within it.
+    size_t Histogram::bucket(std::uint64_t ns)
+    {
+        if(ns < sub_buckets)
+            return ns;
+        size_t bit = 63 - __builtin_clzll(ns);
+        if(bit >= max_bit)
+            return buckets - 1;
+        return (bit - 3) * sub_buckets + ((ns >> (bit - 4)) & (sub_buckets - 1));
+    }
+
+    std::uint64_t Histogram::lowest(size_t i)
+    {
+        if(i < sub_buckets)
+            return i;
+        size_t bit = i / sub_buckets + 3;
+        return std::uint64_t(sub_buckets + i % sub_buckets) << (bit - 4);
+    }
+
+    void Histogram::record(std::uint64_t ns)
+    {
+        std::atomic<std::uint64_t>& c = counts[bucket(ns)];
+        c.store(c.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+        count.store(count.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+        sum.store(sum.load(std::memory_order_relaxed) + ns,std::memory_order_relaxed);
+        if(ns > max.load(std::memory_order_relaxed))
+            max.store(ns,std::memory_order_relaxed);
+    }
+
+    void Histogram::merge(const Histogram& h)
+    {
+        accumulate(counts,h.counts,buckets);
+        accumulate(&count,&h.count,1);
+        accumulate(&sum,&h.sum,1);
+        if(h.getMax() > getMax())
+            max.store(h.getMax(),std::memory_order_relaxed);
+    }
+
+    double Histogram::getMean() const
+    {
+        std::uint64_t n = getCount();
+        return n == 0 ? 0 : double(sum.load(std::memory_order_relaxed)) / n;
+    }
+
+    std::uint64_t Histogram::getPercentile(double p) const
+    {
+        // Counted against the buckets rather than count, which a concurrent
+        // writer may have moved on.
+        std::uint64_t total = 0;
+        for(size_t i = 0;i < buckets;i++)
+            total += counts[i].load(std::memory_order_relaxed);
+        if(total == 0)
+            return 0;
+        std::uint64_t rank = std::uint64_t(p / 100 * total + 0.5);
+        rank = std::min(std::max<std::uint64_t>(rank,1),total);
+        std::uint64_t seen = 0;
+        for(size_t i = 0;i < buckets;i++)
+        {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if(seen >= rank)
+                return i + 1 < buckets ? std::min(lowest(i + 1) - 1,getMax()) : getMax();
+        }
+        return getMax();
+    }
+
+    Metrics::Metrics()
+    {
+        for(size_t i = 0;i < pdu_types;i++)
+        {
+            pdus[i][0].store(0,std::memory_order_relaxed);
+            pdus[i][1].store(0,std::memory_order_relaxed);
+        }
+        for(size_t i = 0;i < failure_codes;i++)
+            failures[i].store(0,std::memory_order_relaxed);
+        for(size_t i = 0;i < counters;i++)
+            values[i].store(0,std::memory_order_relaxed);
+    }
+
+    Metrics::Metrics(const Metrics& m)
+    {
+        *this = m;
+    }
+
+    Metrics& Metrics::operator=(const Metrics& m)
+    {
+        copy(&pdus[0][0],&m.pdus[0][0],pdu_types * 2);
+        copy(failures,m.failures,failure_codes);
+        copy(values,m.values,counters);
+        for(size_t i = 0;i < stages;i++)
+            latency[i] = m.latency[i];
+        return *this;
+    }
+
+    std::uint64_t Metrics::now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::uint64_t Metrics::lap(Stage s,std::uint64_t start)
+    {
+        std::uint64_t t = now();
+        latency[s].record(t - start);
+        return t;
+    }
+
+    void Metrics::merge(const Metrics& m)
+    {
+        accumulate(&pdus[0][0],&m.pdus[0][0],pdu_types * 2);
+        accumulate(failures,m.failures,failure_codes);
+        accumulate(values,m.values,counters);
+        for(size_t i = 0;i < stages;i++)
+            latency[i].merge(m.latency[i]);
+    }
+
+    void Metrics::dump(std::ostream& out) const
+    {
+        static const char* pdu_names[pdu_types] = {"get_request","get_next_request","get_response","set_request","trap","get_bulk_request","inform_request","snmpv2_trap","other"};
+        static const char* failure_names[failure_codes] = {"bad_type","proto_error","bad_oid","too_big","no_memory"};
+        static const char* counter_names[counters] = {"dropped","timeouts","retries"};
+        static const char* stage_names[stages] = {"decode","handler","encode","rtt"};
+        std::ios_base::fmtflags flags = out.flags();
+        out << std::left << std::setw(20) << "pdu" << std::right << std::setw(12) << "decoded" << std::setw(12) << "encoded" << "\n";
+        for(size_t i = 0;i < pdu_types;i++)
+        {
+            if(pdus[i][0].load(std::memory_order_relaxed) != 0 || pdus[i][1].load(std::memory_order_relaxed) != 0)
+                out << std::left << std::setw(20) << pdu_names[i] << std::right << std::setw(12) << pdus[i][0].load(std::memory_order_relaxed) << std::setw(12) << pdus[i][1].load(std::memory_order_relaxed) << "\n";
+        }
+        for(size_t i = 0;i < failure_codes;i++)
+            out << std::left << std::setw(20) << failure_names[i] << std::right << std::setw(12) << failures[i].load(std::memory_order_relaxed) << "\n";
+        for(size_t i = 0;i < counters;i++)
+            out << std::left << std::setw(20) << counter_names[i] << std::right << std::setw(12) << values[i].load(std::memory_order_relaxed) << "\n";
+        out << std::left << std::setw(20) << "latency (ns)" << std::right << std::setw(12) << "count" << std::setw(10) << "mean" << std::setw(10) << "p50"
+            << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(12) << "max" << "\n";
+        for(size_t i = 0;i < stages;i++)
+        {
+            const Histogram& h = latency[i];
+            if(h.getCount() == 0)
+                continue;
+            out << std::left << std::setw(20) << stage_names[i] << std::right << std::setw(12) << h.getCount() << std::setw(10) << std::fixed << std::setprecision(0) << h.getMean()
+                << std::setw(10) << h.getPercentile(50) << std::setw(10) << h.getPercentile(90) << std::setw(10) << h.getPercentile(99)
+                << std::setw(10) << h.getPercentile(99.9) << std::setw(12) << h.getMax() << "\n";
+        }
+        out.flags(flags);
+    }
+}
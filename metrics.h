@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include "snmp.h"
+
+namespace snmp
+{
+    // Latency histogram in nanoseconds with HDR-style log-linear buckets:
+    // exact below 32 ns, then 16 buckets per power of two (6% resolution)
+    // up to 2^40 ns, about 18 minutes, and one bucket for anything longer.
+    // Recording is a few relaxed stores; it must come from one thread at a
+    // time, while any thread may read.
+    class Histogram
+    {
+    public:
+        Histogram();
+        Histogram(const Histogram& h);
+        Histogram& operator=(const Histogram& h);
+        void record(std::uint64_t ns);
+        // Adds the samples of h.
+        void merge(const Histogram& h);
+        std::uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+        std::uint64_t getMax() const { return max.load(std::memory_order_relaxed); }
+        double getMean() const;
+        // Upper bound of the bucket holding the p-th percentile, 0 <= p <= 100.
+        std::uint64_t getPercentile(double p) const;
+    private:
+        enum { sub_buckets = 16, max_bit = 40, buckets = (max_bit - 3) * sub_buckets + 1 };
+        static size_t bucket(std::uint64_t ns);
+        static std::uint64_t lowest(size_t i);
+        std::atomic<std::uint64_t> counts[buckets];
+        std::atomic<std::uint64_t> count;
+        std::atomic<std::uint64_t> sum;
+        std::atomic<std::uint64_t> max;
+    };
+
+    // Counters and latencies of one Agent or Manager. Like those it belongs
+    // to one thread, which is the only writer; other threads read it, take
+    // a snapshot by copying it, or merge the ones of several threads.
+    class Metrics
+    {
+    public:
+        enum Counter { dropped, timeouts, retries, counters };
+        // Agent: decoding the request, answering it, encoding the response.
+        // Manager: encoding requests, decoding responses, running callbacks
+        // and the round trip of requests answered without a resend.
+        enum Stage { decode, handler, encode, rtt, stages };
+        enum { pdu_types = 9, failure_codes = Except::no_memory + 1 };
+        Metrics();
+        Metrics(const Metrics& m);
+        Metrics& operator=(const Metrics& m);
+        // Monotonic clock in nanoseconds, for the stage timings.
+        static std::uint64_t now();
+        void decoded(std::uint8_t pdu_type) { bump(pdus[index(pdu_type)][0]); }
+        void encoded(std::uint8_t pdu_type) { bump(pdus[index(pdu_type)][1]); }
+        void failed(Except::Code code) { bump(failures[code]); }
+        void add(Counter c) { bump(values[c]); }
+        void record(Stage s,std::uint64_t ns) { latency[s].record(ns); }
+        // Records the time since start and returns now, to time back to
+        // back stages.
+        std::uint64_t lap(Stage s,std::uint64_t start);
+        std::uint64_t getDecoded(std::uint8_t pdu_type) const { return pdus[index(pdu_type)][0].load(std::memory_order_relaxed); }
+        std::uint64_t getEncoded(std::uint8_t pdu_type) const { return pdus[index(pdu_type)][1].load(std::memory_order_relaxed); }
+        std::uint64_t getFailures(Except::Code code) const { return failures[code].load(std::memory_order_relaxed); }
+        std::uint64_t getCount(Counter c) const { return values[c].load(std::memory_order_relaxed); }
+        const Histogram& getLatency(Stage s) const { return latency[s]; }
+        void merge(const Metrics& m);
+        // Human readable snapshot.
+        void dump(std::ostream& out) const;
+    private:
+        // 0xa0 to 0xa7 in order, anything else last.
+        static size_t index(std::uint8_t pdu_type) { return pdu_type >= 0xa0 && pdu_type < 0xa8 ? pdu_type - 0xa0 : pdu_types - 1; }
+        static void bump(std::atomic<std::uint64_t>& a,std::uint64_t n = 1) { a.store(a.load(std::memory_order_relaxed) + n,std::memory_order_relaxed); }
+        std::atomic<std::uint64_t> pdus[pdu_types][2];
+        std::atomic<std::uint64_t> failures[failure_codes];
+        std::atomic<std::uint64_t> values[counters];
+        Histogram latency[stages];
+    };
+}
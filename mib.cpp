@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include "mib.h"
+
+namespace snmp
+{
+    static bool subidLess(const std::pair<std::uint32_t,std::uint32_t>& c,std::uint32_t subid)
+    {
+        return c.first < subid;
+    }
+
+    MibRegistry::MibRegistry() : nodes(1)
+    {
+    }
+
+    std::uint32_t MibRegistry::insert(const Oid& oid)
+    {
+        std::uint32_t node = 0;
+        for(size_t i = 0;i < oid.getValueSize();i++)
+        {
+            std::vector<std::pair<std::uint32_t,std::uint32_t> >& c = nodes[node].children;
+            std::vector<std::pair<std::uint32_t,std::uint32_t> >::iterator it = std::lower_bound(c.begin(),c.end(),oid[i],subidLess);
+            if(it == c.end() || it->first != oid[i])
+            {
+                it = c.insert(it,std::make_pair(oid[i],std::uint32_t(nodes.size())));
+                node = it->second;
+                nodes.push_back(Node());
+            }
+            else
+                node = it->second;
+        }
+        return node;
+    }
+
+    std::uint32_t MibRegistry::child(std::uint32_t node,std::uint32_t subid) const
+    {
+        const std::vector<std::pair<std::uint32_t,std::uint32_t> >& c = nodes[node].children;
+        std::vector<std::pair<std::uint32_t,std::uint32_t> >::const_iterator it = std::lower_bound(c.begin(),c.end(),subid,subidLess);
+        if(it == c.end() || it->first != subid)
+            return 0;
+        return it->second;
+    }
+
+    void MibRegistry::addScalar(const Oid& oid,Getter getter)
+    {
+        Node& node = nodes[insert(oid)];
+        node.oid = oid;
+        node.getter = getter;
+    }
+
+    void MibRegistry::addSubtree(const Oid& prefix,std::shared_ptr<MibHandler> handler)
+    {
+        nodes[insert(prefix)].handler = handler;
+    }
+
+    bool MibRegistry::get(const Oid& oid,Varbind& vb) const
+    {
+        std::uint32_t node = 0;
+        for(size_t i = 0;i < oid.getValueSize();i++)
+        {
+            if(nodes[node].handler)
+                return nodes[node].handler->get(oid,vb);
+            if((node = child(node,oid[i])) == 0)
+                return false;
+        }
+        if(nodes[node].handler)
+            return nodes[node].handler->get(oid,vb);
+        if(!nodes[node].getter)
+            return false;
+        vb = nodes[node].getter(oid);
+        return true;
+    }
+
+    bool MibRegistry::getNext(const Oid& oid,Varbind& vb) const
+    {
+        return next(0,oid,0,false,vb);
+    }
+
+    // Finds the first instance below node following oid. depth is the number
+    // of subidentifiers matched so far; after is set once the path has moved
+    // past oid, so that everything below node follows it.
+    bool MibRegistry::next(std::uint32_t node,const Oid& oid,size_t depth,bool after,Varbind& vb) const
+    {
+        const Node& n = nodes[node];
+        if(n.handler)
+            return n.handler->getNext(oid,vb);
+        if(after && n.getter)
+        {
+            vb = n.getter(n.oid);
+            return true;
+        }
+        std::vector<std::pair<std::uint32_t,std::uint32_t> >::const_iterator it = n.children.begin();
+        if(!after)
+        {
+            if(depth < oid.getValueSize())
+                it = std::lower_bound(n.children.begin(),n.children.end(),oid[depth],subidLess);
+            else
+                after = true;
+        }
+        for(;it != n.children.end();it++)
+        {
+            if(next(it->second,oid,depth + 1,after || it->first != oid[depth],vb))
+                return true;
+        }
+        return false;
+    }
+}
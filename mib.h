@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <vector>
+#include <memory>
+#include <functional>
+#include "snmp.h"
+
+namespace snmp
+{
+    // Supplies the values of a whole subtree registered in a MibRegistry.
+    class MibHandler
+    {
+    public:
+        virtual ~MibHandler() {}
+        // Value of the instance oid; false if there is no such instance.
+        virtual bool get(const Oid& oid,Varbind& vb) = 0;
+        // First instance of the subtree that follows oid; false if there is
+        // none. oid may lie before the subtree, then the first instance is
+        // returned.
+        virtual bool getNext(const Oid& oid,Varbind& vb) = 0;
+    };
+
+    // Prefix tree of OID subidentifiers dispatching requests to scalar getters
+    // (exact instances) and subtree handlers. Lookups walk one node per
+    // subidentifier; the registry is not modified by them, so it can be shared
+    // between threads once populated as long as the getters and handlers are
+    // thread safe.
+    class MibRegistry
+    {
+    public:
+        typedef std::function<Varbind(const Oid& oid)> Getter;
+        MibRegistry();
+        void addScalar(const Oid& oid,Getter getter);
+        void addSubtree(const Oid& prefix,std::shared_ptr<MibHandler> handler);
+        bool get(const Oid& oid,Varbind& vb) const;
+        bool getNext(const Oid& oid,Varbind& vb) const;
+    private:
+        struct Node
+        {
+            // (subidentifier, node index) sorted by subidentifier.
+            std::vector<std::pair<std::uint32_t,std::uint32_t> > children;
+            Oid oid;
+            Getter getter;
+            std::shared_ptr<MibHandler> handler;
+        };
+        std::uint32_t insert(const Oid& oid);
+        std::uint32_t child(std::uint32_t node,std::uint32_t subid) const;
+        bool next(std::uint32_t node,const Oid& oid,size_t depth,bool after,Varbind& vb) const;
+        std::vector<Node> nodes;
+    };
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+namespace snmp
+{
+    // Bounded queue for any number of producers and consumers, without locks
+    // (after D. Vyukov's array queue). Every cell carries a sequence number
+    // saying whether it is free for the push of a given round or holds the
+    // value for its pop, so a push and a pop only contend on their own index.
+    // The capacity is rounded up to a power of two.
+    template <typename T> class BoundedQueue
+    {
+    public:
+        explicit BoundedQueue(size_t n) : mask(roundUp(n) - 1), head(0), tail(0)
+        {
+            cells.reset(new Cell[mask + 1]);
+            for(size_t i = 0;i <= mask;i++)
+                cells[i].sequence.store(i,std::memory_order_relaxed);
+        }
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+        size_t capacity() const { return mask + 1; }
+        // Returns false if the queue is full.
+        bool push(const T& v)
+        {
+            size_t pos = head.load(std::memory_order_relaxed);
+            for(;;)
+            {
+                Cell& cell = cells[pos & mask];
+                size_t seq = cell.sequence.load(std::memory_order_acquire);
+                if(seq == pos)
+                {
+                    if(head.compare_exchange_weak(pos,pos + 1,std::memory_order_relaxed))
+                    {
+                        cell.value = v;
+                        cell.sequence.store(pos + 1,std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if(seq < pos)
+                    return false;
+                else
+                    pos = head.load(std::memory_order_relaxed);
+            }
+        }
+        // Returns false if the queue is empty.
+        bool pop(T& v)
+        {
+            size_t pos = tail.load(std::memory_order_relaxed);
+            for(;;)
+            {
+                Cell& cell = cells[pos & mask];
+                size_t seq = cell.sequence.load(std::memory_order_acquire);
+                if(seq == pos + 1)
+                {
+                    if(tail.compare_exchange_weak(pos,pos + 1,std::memory_order_relaxed))
+                    {
+                        v = cell.value;
+                        cell.sequence.store(pos + mask + 1,std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if(seq < pos + 1)
+                    return false;
+                else
+                    pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        // Only a hint while other threads push or pop.
+        bool empty() const
+        {
+            size_t pos = tail.load(std::memory_order_acquire);
+            return cells[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1;
+        }
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+        static size_t roundUp(size_t n)
+        {
+            size_t p = 2;
+            while(p < n)
+                p <<= 1;
+            return p;
+        }
+        std::unique_ptr<Cell[]> cells;
+        const size_t mask;
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+    };
+}
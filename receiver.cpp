@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <memory_resource>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "receiver.h"
+
+namespace snmp
+{
+    TrapReceiver::TrapReceiver(const boost::asio::ip::udp::endpoint& ep,size_t n) :
+        socket(io_service), endpoint(ep), slots(queue_size), free_slots(queue_size), filled(queue_size),
+        running(false), reading(false), received(0), sleepers(0), blocked(false)
+    {
+        socket.open(endpoint.protocol());
+        socket.set_option(boost::asio::socket_base::receive_buffer_size(receive_buffer));
+        // Past net.core.rmem_max when the process is allowed to.
+        int size = receive_buffer;
+        ::setsockopt(socket.native_handle(),SOL_SOCKET,SO_RCVBUFFORCE,&size,sizeof(size));
+        // Lets the reader see stop() without any other wakeup.
+        struct timeval tv = { 0, poll_interval * 1000 };
+        ::setsockopt(socket.native_handle(),SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+        socket.bind(endpoint);
+        endpoint = socket.local_endpoint();
+        for(std::uint32_t i = 0;i < slots.size();i++)
+        {
+            slots[i].data.resize(slot_size);
+            free_slots.push(i);
+        }
+        for(size_t i = 0;i < n;i++)
+            workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    }
+
+    TrapReceiver::~TrapReceiver()
+    {
+        stop();
+    }
+
+    void TrapReceiver::start()
+    {
+        if(running.exchange(true))
+            return;
+        reading = true;
+        for(std::unique_ptr<Worker>& w : workers)
+        {
+            Worker* p = w.get();
+            w->thread = std::thread([this,p]() { run(*p); });
+        }
+        reader = std::thread([this]() { read(); });
+    }
+
+    void TrapReceiver::stop()
+    {
+        running = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            room.notify_all();
+        }
+        if(reader.joinable())
+            reader.join();
+        reading = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.notify_all();
+        }
+        for(std::unique_ptr<Worker>& w : workers)
+        {
+            if(w->thread.joinable())
+                w->thread.join();
+        }
+    }
+
+    std::uint64_t TrapReceiver::getDelivered() const
+    {
+        std::uint64_t n = 0;
+        for(const std::unique_ptr<Worker>& w : workers)
+            n += w->delivered.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    std::uint64_t TrapReceiver::getMalformed() const
+    {
+        std::uint64_t n = 0;
+        for(const std::unique_ptr<Worker>& w : workers)
+            n += w->malformed.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    std::uint64_t TrapReceiver::getErrors() const
+    {
+        std::uint64_t n = 0;
+        for(const std::unique_ptr<Worker>& w : workers)
+            n += w->errors.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    void TrapReceiver::read()
+    {
+        // Room for the part of each datagram that does not fit its slot.
+        std::vector<std::uint8_t> overflow(read_batch * datagram_size);
+        std::vector<std::uint32_t> claimed;
+        claimed.reserve(read_batch);
+        while(running.load(std::memory_order_relaxed))
+        {
+            // Receives into as many free slots as there are, at least one.
+            std::uint32_t slot;
+            while(claimed.size() < read_batch && free_slots.pop(slot))
+                claimed.push_back(slot);
+            if(claimed.empty())
+            {
+                if(!claim(slot))
+                    break;
+                claimed.push_back(slot);
+            }
+            size_t n = receive(claimed,overflow);
+            // Cannot fail, there are no more slots than cells.
+            for(size_t i = 0;i < n;i++)
+                filled.push(claimed[i]);
+            claimed.erase(claimed.begin(),claimed.begin() + n);
+            if(n > 0)
+            {
+                received.fetch_add(n,std::memory_order_relaxed);
+                wake();
+            }
+        }
+        for(std::uint32_t slot : claimed)
+            free_slots.push(slot);
+    }
+
+    size_t TrapReceiver::receive(const std::vector<std::uint32_t>& claimed,std::vector<std::uint8_t>& overflow)
+    {
+        struct iovec iov[read_batch][2];
+        for(size_t i = 0;i < claimed.size();i++)
+        {
+            Slot& s = slots[claimed[i]];
+            iov[i][0].iov_base = s.data.data();
+            iov[i][0].iov_len = s.data.size();
+            iov[i][1].iov_base = overflow.data() + i * datagram_size;
+            iov[i][1].iov_len = s.data.size() < datagram_size ? datagram_size - s.data.size() : 0;
+        }
+#if defined(__linux__)
+        struct mmsghdr headers[read_batch];
+        std::memset(headers,0,sizeof(headers));
+        for(size_t i = 0;i < claimed.size();i++)
+        {
+            Slot& s = slots[claimed[i]];
+            headers[i].msg_hdr.msg_name = s.source.data();
+            headers[i].msg_hdr.msg_namelen = s.source.capacity();
+            headers[i].msg_hdr.msg_iov = iov[i];
+            headers[i].msg_hdr.msg_iovlen = 2;
+        }
+        // Blocks for the first datagram only, up to SO_RCVTIMEO.
+        int r = ::recvmmsg(socket.native_handle(),headers,claimed.size(),MSG_WAITFORONE,0);
+        size_t n = r > 0 ? r : 0;
+#else
+        struct msghdr header;
+        std::memset(&header,0,sizeof(header));
+        Slot& first = slots[claimed[0]];
+        header.msg_name = first.source.data();
+        header.msg_namelen = first.source.capacity();
+        header.msg_iov = iov[0];
+        header.msg_iovlen = 2;
+        ssize_t length = ::recvmsg(socket.native_handle(),&header,0);
+        size_t n = length >= 0 ? 1 : 0;
+#endif
+        for(size_t i = 0;i < n;i++)
+        {
+            Slot& s = slots[claimed[i]];
+#if defined(__linux__)
+            s.length = headers[i].msg_len;
+            s.source.resize(headers[i].msg_hdr.msg_namelen);
+#else
+            s.length = length;
+            s.source.resize(header.msg_namelen);
+#endif
+            size_t head = iov[i][0].iov_len;
+            if(s.length > head)
+            {
+                s.data.resize(s.length);
+                std::memcpy(s.data.data() + head,iov[i][1].iov_base,s.length - head);
+            }
+        }
+        return n;
+    }
+
+    bool TrapReceiver::claim(std::uint32_t& slot)
+    {
+        // Every slot is taken: sleep until a worker returns one rather than
+        // drop datagrams; they wait in the socket buffer meanwhile.
+        while(!free_slots.pop(slot))
+        {
+            if(!running.load(std::memory_order_relaxed))
+                return false;
+            wake();
+            std::unique_lock<std::mutex> lock(mutex);
+            blocked.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(free_slots.empty() && running.load())
+                room.wait_for(lock,std::chrono::milliseconds(poll_interval));
+            blocked.store(false);
+        }
+        return true;
+    }
+
+    void TrapReceiver::release(std::uint32_t slot)
+    {
+        free_slots.push(slot);
+        // Pairs with the fence in claim(), as wake() does with wait().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(blocked.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            room.notify_one();
+        }
+    }
+
+    void TrapReceiver::wake()
+    {
+        // Pairs with the fence in wait(): either the worker sees the queued
+        // slot or the reader sees the sleeper.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(sleepers.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.notify_all();
+        }
+    }
+
+    void TrapReceiver::wait()
+    {
+        for(int i = 0;i < spin;i++)
+        {
+            if(!filled.empty())
+                return;
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        sleepers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(filled.empty() && reading.load())
+            ready.wait_for(lock,std::chrono::milliseconds(poll_interval));
+        sleepers.fetch_sub(1);
+    }
+
+    void TrapReceiver::run(Worker& w)
+    {
+        // A batch is decoded into one arena, which is reset once the sinks
+        // are done with it; it only reaches the heap for unusually large
+        // batches.
+        std::vector<std::uint8_t> buffer(arena_size);
+        std::pmr::monotonic_buffer_resource arena(buffer.data(),buffer.size());
+        std::vector<Notification> batch;
+        batch.reserve(batch_size);
+        for(;;)
+        {
+            std::uint32_t slot;
+            if(filled.pop(slot))
+            {
+                const Slot& s = slots[slot];
+                batch.emplace_back(&arena);
+                Notification& n = batch.back();
+                n.source = s.source;
+                Status status;
+                bool decoded = n.message.read(s.data.data(),s.data.data() + s.length,status) != 0;
+                // The message owns what it decoded, the slot can go back.
+                release(slot);
+                std::uint8_t type = decoded ? n.message.getPDUType() : 0;
+                if(!decoded || (type != Complex::trap && type != Complex::snmpv2_trap && type != Complex::inform_request))
+                {
+                    batch.pop_back();
+                    w.malformed.fetch_add(1,std::memory_order_relaxed);
+                    continue;
+                }
+                if(type == Complex::inform_request)
+                {
+                    // Still delivered; the sender retries the inform.
+                    try
+                    {
+                        acknowledge(n,&arena);
+                    }
+                    catch(...)
+                    {
+                        w.errors.fetch_add(1,std::memory_order_relaxed);
+                    }
+                }
+                if(batch.size() < batch_size)
+                    continue;
+            }
+            else if(batch.empty())
+            {
+                if(!reading.load() && filled.empty())
+                    break;
+                wait();
+                continue;
+            }
+            // The batch is full or there is nothing more to add to it.
+            // A sink that throws does not keep the batch from the others.
+            for(const Sink& sink : sinks)
+            {
+                try
+                {
+                    sink(Span<Notification>(batch.data(),batch.size()));
+                }
+                catch(...)
+                {
+                    w.errors.fetch_add(1,std::memory_order_relaxed);
+                }
+            }
+            w.delivered.fetch_add(batch.size(),std::memory_order_relaxed);
+            batch.clear();
+            arena.release();
+        }
+    }
+
+    void TrapReceiver::acknowledge(const Notification& n,std::pmr::memory_resource* resource)
+    {
+        // The response repeats the request-id and varbinds with zero error
+        // fields, so it is about as long as the inform; the encoder grows
+        // when the lengths re-encode longer, and throws past a datagram.
+        const Message& m = n.message;
+        Encoder enc(resource,m.getSize() + 16,max_datagram);
+        size_t outer = enc.mark();
+        size_t inner = enc.mark();
+        enc.write(m.getPDU().getVarbinds());
+        enc.writeInteger(0);
+        enc.writeInteger(0);
+        enc.write(m.getPDU().getRequestID());
+        enc.close(Complex::get_response,inner);
+        enc.write(m.getCommunity());
+        enc.write(m.getVersion());
+        enc.close(Complex::sequence,outer);
+        ::sendto(socket.native_handle(),enc.data(),enc.size(),0,n.source.data(),n.source.size());
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <boost/asio.hpp>
+#include "snmp.h"
+#include "queue.h"
+
+namespace snmp
+{
+    // A trap or notification as handed to sinks: v1 Trap-PDUs (see
+    // Message::getTrap), v2c SNMPv2-Traps and InformRequests.
+    struct Notification
+    {
+        explicit Notification(std::pmr::memory_resource* resource) : message(resource) {}
+        boost::asio::ip::udp::endpoint source;
+        Message message;
+    };
+
+    // Notification receiver built to take storms without losing traps. One
+    // thread reads datagrams from the socket and hands them through a lock
+    // free queue to the decoding workers, which pass what they decode to the
+    // sinks in batches. Datagrams are received straight into the queue's
+    // slots. When the workers fall behind the reader blocks until a slot is
+    // returned instead of discarding datagrams, so the backlog builds up in
+    // the (enlarged) socket buffer. Informs are acknowledged by the worker
+    // that decodes them.
+    class TrapReceiver
+    {
+    public:
+        // Sinks are called from the workers, concurrently, with up to
+        // batch_size notifications at a time. The notifications only live
+        // for the duration of the call.
+        typedef std::function<void(Span<Notification>)> Sink;
+        TrapReceiver(const boost::asio::ip::udp::endpoint& ep,size_t workers);
+        TrapReceiver(const TrapReceiver&) = delete;
+        TrapReceiver& operator=(const TrapReceiver&) = delete;
+        ~TrapReceiver();
+        // Sinks must be added before start().
+        void addSink(const Sink& sink) { sinks.push_back(sink); }
+        void start();
+        // Stops reading, lets the workers deliver everything already queued
+        // and joins the threads.
+        void stop();
+        // The bound address; a port of 0 is replaced by the one assigned.
+        const boost::asio::ip::udp::endpoint& getEndpoint() const { return endpoint; }
+        std::uint64_t getReceived() const { return received.load(std::memory_order_relaxed); }
+        std::uint64_t getDelivered() const;
+        // Datagrams that were not a well formed trap, notification or inform.
+        std::uint64_t getMalformed() const;
+        // Sink calls that threw and informs that could not be acknowledged;
+        // neither stops the worker.
+        std::uint64_t getErrors() const;
+    private:
+        enum { queue_size = 8192, batch_size = 64, read_batch = 64, slot_size = 2048, datagram_size = 65536,
+            max_datagram = 65507, arena_size = 1024 * 1024, receive_buffer = 16 * 1024 * 1024, poll_interval = 100, spin = 64 };
+        // The datagram is received into data, which holds slot_size bytes;
+        // a longer one spills into the reader's overflow buffer and the slot
+        // is grown to take the rest.
+        struct Slot
+        {
+            std::vector<std::uint8_t> data;
+            size_t length;
+            boost::asio::ip::udp::endpoint source;
+        };
+        struct alignas(64) Worker
+        {
+            Worker() : delivered(0), malformed(0), errors(0) {}
+            std::thread thread;
+            std::atomic<std::uint64_t> delivered;
+            std::atomic<std::uint64_t> malformed;
+            std::atomic<std::uint64_t> errors;
+        };
+        void read();
+        size_t receive(const std::vector<std::uint32_t>& claimed,std::vector<std::uint8_t>& overflow);
+        bool claim(std::uint32_t& slot);
+        void release(std::uint32_t slot);
+        void run(Worker& w);
+        void wait();
+        void wake();
+        void acknowledge(const Notification& n,std::pmr::memory_resource* resource);
+        boost::asio::io_service io_service;
+        boost::asio::ip::udp::socket socket;
+        boost::asio::ip::udp::endpoint endpoint;
+        std::vector<Sink> sinks;
+        std::vector<Slot> slots;
+        // Slot numbers: free ones go to the reader, filled ones to the workers.
+        BoundedQueue<std::uint32_t> free_slots;
+        BoundedQueue<std::uint32_t> filled;
+        std::thread reader;
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<bool> running;
+        std::atomic<bool> reading;
+        std::atomic<std::uint64_t> received;
+        // Idle workers sleep on ready; the reader only takes the lock when the
+        // count says someone is waiting. The reader sleeps on room when every
+        // slot is taken, and the workers only take the lock when it does.
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::condition_variable room;
+        std::atomic<int> sleepers;
+        std::atomic<bool> blocked;
+    };
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <memory_resource>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "server.h"
+#include "agent.h"
+#include "datagram.h"
+
+namespace snmp
+{
+    typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET,SO_REUSEPORT> reuse_port;
+
+    AgentServer::AgentServer(const MibRegistry& _mib,const std::string& _community,const boost::asio::ip::udp::endpoint& ep,size_t n) :
+        mib(_mib), community(_community), endpoint(ep), running(false)
+    {
+        for(size_t i = 0;i < n;i++)
+        {
+            workers.push_back(std::unique_ptr<Worker>(new Worker(io_service)));
+            boost::asio::ip::udp::socket& s = workers.back()->socket;
+            s.open(endpoint.protocol());
+            s.set_option(reuse_port(true));
+            s.set_option(boost::asio::socket_base::receive_buffer_size(4 * 1024 * 1024));
+            // Lets a blocked worker see stop() without any other wakeup.
+            struct timeval tv = { 0, poll_interval * 1000 };
+            ::setsockopt(s.native_handle(),SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+            s.bind(endpoint);
+            if(i == 0)
+                endpoint = s.local_endpoint();
+        }
+    }
+
+    AgentServer::~AgentServer()
+    {
+        stop();
+    }
+
+    void AgentServer::start()
+    {
+        if(running.exchange(true))
+            return;
+        for(std::unique_ptr<Worker>& w : workers)
+        {
+            Worker* p = w.get();
+            w->thread = std::thread([this,p]() { run(*p); });
+        }
+    }
+
+    void AgentServer::stop()
+    {
+        running = false;
+        for(std::unique_ptr<Worker>& w : workers)
+        {
+            if(w->thread.joinable())
+                w->thread.join();
+        }
+    }
+
+    std::uint64_t AgentServer::getRequests() const
+    {
+        std::uint64_t n = 0;
+        for(const std::unique_ptr<Worker>& w : workers)
+            n += w->requests.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    std::uint64_t AgentServer::getDropped() const
+    {
+        std::uint64_t n = 0;
+        for(const std::unique_ptr<Worker>& w : workers)
+            n += w->dropped.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    Metrics AgentServer::getMetrics() const
+    {
+        Metrics m;
+        for(const std::unique_ptr<Worker>& w : workers)
+            m.merge(w->metrics);
+        return m;
+    }
+
+    void AgentServer::run(Worker& w)
+    {
+        // Everything the worker allocates while answering comes from its own
+        // pool, which needs no locking.
+        std::pmr::unsynchronized_pool_resource pool;
+        Agent agent(mib,community,&pool);
+        agent.setMetrics(&w.metrics);
+        DatagramBatch requests(batch_size,request_size);
+        DatagramBatch responses(batch_size,Agent::default_max_size);
+        int fd = w.socket.native_handle();
+        while(running.load(std::memory_order_relaxed))
+        {
+            boost::system::error_code ec;
+            size_t n = requests.receive(fd,true,ec);
+            if(n == 0)
+                continue;
+            responses.clear();
+            for(size_t i = 0;i < n;i++)
+            {
+                size_t length;
+                try
+                {
+                    length = agent.respond(requests.data(i),requests.data(i) + requests.length(i),responses.buffer(),responses.bufferSize());
+                }
+                catch(...)
+                {
+                    // A throwing handler or allocation costs this request
+                    // only, never the worker.
+                    w.metrics.add(Metrics::dropped);
+                    continue;
+                }
+                if(length == 0)
+                    continue;
+                responses.push(length,requests.endpoint(i));
+            }
+            w.requests.fetch_add(n,std::memory_order_relaxed);
+            w.dropped.fetch_add(n - responses.size(),std::memory_order_relaxed);
+            for(size_t sent = 0;sent < responses.size();)
+            {
+                sent += responses.send(fd,sent,ec);
+                if(ec)
+                {
+                    w.dropped.fetch_add(1,std::memory_order_relaxed);
+                    sent++;
+                }
+            }
+        }
+    }
+}
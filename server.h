@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <boost/asio.hpp>
+#include "mib.h"
+#include "metrics.h"
+
+namespace snmp
+{
+    // Multi-threaded agent: each worker thread owns a UDP socket bound with
+    // SO_REUSEPORT to the same address, so the kernel spreads managers over
+    // the workers. Workers share nothing but the MibRegistry, which is only
+    // read; its getters and handlers must be safe to call concurrently.
+    class AgentServer
+    {
+    public:
+        AgentServer(const MibRegistry& _mib,const std::string& _community,const boost::asio::ip::udp::endpoint& ep,size_t workers);
+        AgentServer(const AgentServer&) = delete;
+        AgentServer& operator=(const AgentServer&) = delete;
+        ~AgentServer();
+        void start();
+        // Stops and joins the workers; they notice within poll_interval.
+        void stop();
+        // The bound address; a port of 0 is replaced by the one assigned.
+        const boost::asio::ip::udp::endpoint& getEndpoint() const { return endpoint; }
+        size_t getWorkers() const { return workers.size(); }
+        std::uint64_t getRequests() const;
+        std::uint64_t getDropped() const;
+        // Snapshot of the metrics of all workers merged.
+        Metrics getMetrics() const;
+    private:
+        enum { batch_size = 64, request_size = 2048, poll_interval = 100 };
+        struct alignas(64) Worker
+        {
+            explicit Worker(boost::asio::io_service& io) : socket(io), requests(0), dropped(0) {}
+            boost::asio::ip::udp::socket socket;
+            std::thread thread;
+            std::atomic<std::uint64_t> requests;
+            std::atomic<std::uint64_t> dropped;
+            Metrics metrics;
+        };
+        void run(Worker& w);
+        const MibRegistry& mib;
+        std::string community;
+        boost::asio::io_service io_service;
+        boost::asio::ip::udp::endpoint endpoint;
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<bool> running;
+    };
+}
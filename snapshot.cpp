@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+
+namespace snmp
+{
+    // File layout, in host byte order: the header, count entries sorted by
+    // key, the prefix index, the keys and the encoded varbinds. Keys start
+    // with the prefix_length bytes all of them share, stored once at the
+    // start of the keys; entries point at the rest. index[b] is the first
+    // entry whose key continues the prefix with index_bytes bytes of at
+    // least b, short keys padded with zeros.
+    struct MibSnapshot::Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t count;
+        std::uint32_t prefix_length;
+        std::uint32_t index_bytes;
+        std::uint64_t entries;
+        std::uint64_t index;
+        std::uint64_t keys;
+        std::uint64_t values;
+        std::uint64_t size;
+    };
+
+    struct MibSnapshot::Entry
+    {
+        std::uint32_t key;
+        std::uint32_t key_length;
+        std::uint32_t value;
+        std::uint32_t value_length;
+    };
+
+    static const char magic[8] = {'S','N','M','P','M','I','B','\0'};
+    // Also tells the byte order apart.
+    static const std::uint32_t version = 1;
+
+    static size_t buckets(size_t index_bytes)
+    {
+        return size_t(1) << (8 * index_bytes);
+    }
+
+    static size_t bucket(std::string_view k,size_t index_bytes)
+    {
+        size_t b = 0;
+        for(size_t i = 0;i < index_bytes;i++)
+            b = b << 8 | (i < k.size() ? std::uint8_t(k[i]) : 0);
+        return b;
+    }
+
+    static void writeFile(const std::string& path,const std::vector<std::uint8_t>& d)
+    {
+        // Written aside and renamed over path, so that readers, including
+        // snapshots still mapping the old file, never see it half written.
+        std::string tmp = path + ".tmp";
+        int fd = ::open(tmp.c_str(),O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+        if(fd < 0)
+            throw std::system_error(errno,std::generic_category(),tmp);
+        size_t done = 0;
+        while(done < d.size())
+        {
+            ssize_t n = ::write(fd,d.data() + done,d.size() - done);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0)
+            {
+                int error = errno;
+                ::close(fd);
+                ::unlink(tmp.c_str());
+                throw std::system_error(error,std::generic_category(),tmp);
+            }
+            done += n;
+        }
+        if(::fsync(fd) != 0 || ::close(fd) != 0 || ::rename(tmp.c_str(),path.c_str()) != 0)
+        {
+            int error = errno;
+            ::unlink(tmp.c_str());
+            throw std::system_error(error,std::generic_category(),path);
+        }
+    }
+
+    MibSnapshot::MibSnapshot(const std::string& path) : overlay_size(0)
+    {
+        int fd = ::open(path.c_str(),O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            throw std::system_error(errno,std::generic_category(),path);
+        struct stat st;
+        if(::fstat(fd,&st) != 0)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error,std::generic_category(),path);
+        }
+        length = st.st_size;
+        if(length < sizeof(Header))
+        {
+            ::close(fd);
+            throw std::runtime_error(path + ": not a MIB snapshot");
+        }
+        void* p = ::mmap(0,length,PROT_READ,MAP_PRIVATE,fd,0);
+        int error = errno;
+        ::close(fd);
+        if(p == MAP_FAILED)
+            throw std::system_error(error,std::generic_category(),path);
+        data = static_cast<const std::uint8_t*>(p);
+
+        // Everything the lookups rely on is checked once here, so that they
+        // stay within the mapping whatever the file holds.
+        const Header& h = *reinterpret_cast<const Header*>(data);
+        bool valid = std::memcmp(h.magic,magic,sizeof(magic)) == 0 && h.version == version && h.size == length && h.index_bytes <= 2 &&
+            h.entries == sizeof(Header) && h.entries + std::uint64_t(h.count) * sizeof(Entry) == h.index &&
+            h.index + (buckets(h.index_bytes) + 1) * sizeof(std::uint32_t) == h.keys && h.keys + h.prefix_length <= h.values &&
+            h.values <= h.size && h.prefix_length <= max_key;
+        if(valid)
+        {
+            count = h.count;
+            prefix_length = h.prefix_length;
+            index_bytes = h.index_bytes;
+            entries = reinterpret_cast<const Entry*>(data + h.entries);
+            index = reinterpret_cast<const std::uint32_t*>(data + h.index);
+            keys = data + h.keys;
+            values = data + h.values;
+            size_t keys_size = h.values - h.keys;
+            size_t values_size = h.size - h.values;
+            for(size_t i = 0;valid && i < count;i++)
+            {
+                const Entry& e = entries[i];
+                valid = e.key >= prefix_length && e.key <= keys_size && e.key_length <= keys_size - e.key && prefix_length + e.key_length <= max_key &&
+                    e.value <= values_size && e.value_length <= values_size - e.value;
+            }
+            valid = valid && index[0] == 0 && index[buckets(index_bytes)] == count;
+            for(size_t b = 0;valid && b < buckets(index_bytes);b++)
+                valid = index[b] <= index[b + 1];
+        }
+        if(!valid)
+        {
+            ::munmap(const_cast<std::uint8_t*>(data),length);
+            throw std::runtime_error(path + ": not a MIB snapshot");
+        }
+    }
+
+    MibSnapshot::~MibSnapshot()
+    {
+        ::munmap(const_cast<std::uint8_t*>(data),length);
+    }
+
+    // Each subidentifier in 1 to 5 bytes, the count of leading one bits of
+    // the first byte telling how many follow, so that comparing keys byte by
+    // byte orders them like the oids. BER does not: 16384 encodes as
+    // 81 80 00, below the 16383 of ff 7f.
+    static size_t encodeKey(const std::uint32_t* arcs,size_t n,std::uint8_t* k)
+    {
+        std::uint8_t* p = k;
+        for(size_t i = 0;i < n;i++)
+        {
+            std::uint32_t v = arcs[i];
+            if(v < 0x80)
+                *p++ = v;
+            else if(v < 0x4000)
+            {
+                *p++ = 0x80 | v >> 8;
+                *p++ = v;
+            }
+            else if(v < 0x200000)
+            {
+                *p++ = 0xc0 | v >> 16;
+                *p++ = v >> 8;
+                *p++ = v;
+            }
+            else if(v < 0x10000000)
+            {
+                *p++ = 0xe0 | v >> 24;
+                *p++ = v >> 16;
+                *p++ = v >> 8;
+                *p++ = v;
+            }
+            else
+            {
+                *p++ = 0xf0;
+                *p++ = v >> 24;
+                *p++ = v >> 16;
+                *p++ = v >> 8;
+                *p++ = v;
+            }
+        }
+        return p - k;
+    }
+
+    size_t MibSnapshot::key(const Oid& oid,std::uint8_t* k)
+    {
+        return encodeKey(oid.getValue(),std::min<size_t>(oid.getValueSize(),max_subidentifiers),k);
+    }
+
+    std::string_view MibSnapshot::key(size_t i) const
+    {
+        return std::string_view(reinterpret_cast<const char*>(keys + entries[i].key),entries[i].key_length);
+    }
+
+    // Index of the entry whose key is k, or with next of the first one after
+    // k; count if there is none.
+    size_t MibSnapshot::find(std::string_view k,bool next) const
+    {
+        std::string_view prefix(reinterpret_cast<const char*>(keys),prefix_length);
+        int c = k.substr(0,prefix_length).compare(prefix);
+        if(c < 0)
+            return next ? 0 : count;
+        if(c > 0)
+            return count;
+        std::string_view rest = k.substr(prefix_length);
+        size_t b = bucket(rest,index_bytes);
+        const Entry* first = entries + index[b];
+        const Entry* last = entries + index[b + 1];
+        if(next)
+        {
+            // Past the bucket, the first entry of the next ones follows k.
+            return std::upper_bound(first,last,rest,[this](std::string_view r,const Entry& e) { return r < key(&e - entries); }) - entries;
+        }
+        const Entry* e = std::lower_bound(first,last,rest,[this](const Entry& e,std::string_view r) { return key(&e - entries) < r; });
+        return e != last && key(e - entries) == rest ? e - entries : count;
+    }
+
+    bool MibSnapshot::value(size_t i,Varbind& vb) const
+    {
+        Status status;
+        const std::uint8_t* b = values + entries[i].value;
+        return vb.read(b,b + entries[i].value_length,status) != 0;
+    }
+
+    bool MibSnapshot::get(const Oid& oid,Varbind& vb)
+    {
+        if(oid.getValueSize() > max_subidentifiers)
+            return false;
+        std::uint8_t buffer[max_key];
+        std::string_view k(reinterpret_cast<const char*>(buffer),key(oid,buffer));
+        if(overlay_size.load(std::memory_order_acquire) != 0)
+        {
+            std::shared_lock<std::shared_mutex> lock(overlay_mutex);
+            Overlay::const_iterator it = overlay.find(k);
+            if(it != overlay.end())
+            {
+                if(!it->second)
+                    return false;
+                vb = *it->second;
+                return true;
+            }
+        }
+        size_t i = find(k,false);
+        return i < count && value(i,vb);
+    }
+
+    bool MibSnapshot::getNext(const Oid& oid,Varbind& vb)
+    {
+        // Longer oids than any instance follow the same ones as their first
+        // max_subidentifiers subidentifiers.
+        std::uint8_t buffer[max_key];
+        std::string_view k(reinterpret_cast<const char*>(buffer),key(oid,buffer));
+        size_t i = find(k,true);
+        if(overlay_size.load(std::memory_order_acquire) != 0)
+        {
+            std::shared_lock<std::shared_mutex> lock(overlay_mutex);
+            Overlay::const_iterator it = overlay.upper_bound(k);
+            while(it != overlay.end() && !it->second)
+                it++;
+            // Entries the overlay replaces or hides are skipped; a
+            // replacement is found through it instead.
+            std::uint8_t full[max_key];
+            std::memcpy(full,keys,prefix_length);
+            std::string_view f;
+            for(;i < count;i++)
+            {
+                std::string_view rest = key(i);
+                std::memcpy(full + prefix_length,rest.data(),rest.size());
+                f = std::string_view(reinterpret_cast<const char*>(full),prefix_length + rest.size());
+                if(overlay.find(f) == overlay.end())
+                    break;
+            }
+            if(it != overlay.end() && (i == count || std::string_view(it->first) < f))
+            {
+                vb = *it->second;
+                return true;
+            }
+        }
+        return i < count && value(i,vb);
+    }
+
+    void MibSnapshot::set(const Varbind& vb)
+    {
+        if(vb.getOid().getValueSize() > max_subidentifiers)
+            throw Except(&vb.getOid(),Except::bad_oid);
+        std::uint8_t buffer[max_key];
+        std::string k(reinterpret_cast<const char*>(buffer),key(vb.getOid(),buffer));
+        std::unique_lock<std::shared_mutex> lock(overlay_mutex);
+        overlay[k] = vb;
+        overlay_size.store(overlay.size(),std::memory_order_release);
+    }
+
+    void MibSnapshot::erase(const Oid& oid)
+    {
+        if(oid.getValueSize() > max_subidentifiers)
+            return;
+        std::uint8_t buffer[max_key];
+        std::string k(reinterpret_cast<const char*>(buffer),key(oid,buffer));
+        std::unique_lock<std::shared_mutex> lock(overlay_mutex);
+        // Only instances of the file need hiding.
+        if(find(k,false) == count)
+            overlay.erase(k);
+        else
+            overlay[k] = std::nullopt;
+        overlay_size.store(overlay.size(),std::memory_order_release);
+    }
+
+    void MibSnapshot::write(const std::string& path,std::vector<Varbind> vbs)
+    {
+        std::vector<std::string> k(vbs.size());
+        std::vector<size_t> order(vbs.size());
+        for(size_t i = 0;i < vbs.size();i++)
+        {
+            if(vbs[i].getOid().getValueSize() > max_subidentifiers)
+                throw Except(&vbs[i].getOid(),Except::bad_oid);
+            std::uint8_t buffer[max_key];
+            k[i].assign(reinterpret_cast<const char*>(buffer),key(vbs[i].getOid(),buffer));
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(),order.end(),[&k](size_t a,size_t b) { return k[a] < k[b]; });
+        std::vector<size_t> unique;
+        for(size_t i = 0;i < order.size();i++)
+        {
+            if(i + 1 == order.size() || k[order[i]] != k[order[i + 1]])
+                unique.push_back(order[i]);
+        }
+
+        Header h;
+        std::memcpy(h.magic,magic,sizeof(magic));
+        h.version = version;
+        h.count = unique.size();
+        // The sorted keys share what the first and the last share.
+        size_t prefix = 0;
+        if(!unique.empty())
+        {
+            const std::string& first = k[unique.front()];
+            const std::string& last = k[unique.back()];
+            while(prefix < first.size() && prefix < last.size() && first[prefix] == last[prefix])
+                prefix++;
+        }
+        h.prefix_length = prefix;
+        h.index_bytes = unique.size() < 256 ? 0 : unique.size() < 65536 ? 1 : 2;
+        h.entries = sizeof(Header);
+        h.index = h.entries + unique.size() * sizeof(Entry);
+        h.keys = h.index + (buckets(h.index_bytes) + 1) * sizeof(std::uint32_t);
+
+        std::vector<std::uint8_t> keys(prefix);
+        if(prefix != 0)
+            std::memcpy(keys.data(),k[unique.front()].data(),prefix);
+        std::vector<std::uint8_t> values;
+        std::vector<Entry> entries(unique.size());
+        std::vector<std::uint32_t> index(buckets(h.index_bytes) + 1);
+        size_t b = 0;
+        for(size_t i = 0;i < unique.size();i++)
+        {
+            std::string_view rest = std::string_view(k[unique[i]]).substr(prefix);
+            entries[i].key = keys.size();
+            entries[i].key_length = rest.size();
+            keys.insert(keys.end(),rest.begin(),rest.end());
+            entries[i].value = values.size();
+            vbs[unique[i]].write(values);
+            entries[i].value_length = values.size() - entries[i].value;
+            for(size_t c = bucket(rest,h.index_bytes);b <= c;b++)
+                index[b] = i;
+        }
+        for(;b < index.size();b++)
+            index[b] = unique.size();
+        if(keys.size() > UINT32_MAX || values.size() > UINT32_MAX)
+            throw std::length_error(path + ": MIB snapshot too large");
+        h.values = h.keys + keys.size();
+        h.size = h.values + values.size();
+
+        std::vector<std::uint8_t> d(h.keys);
+        std::memcpy(d.data(),&h,sizeof(h));
+        if(!entries.empty())
+            std::memcpy(d.data() + h.entries,entries.data(),entries.size() * sizeof(Entry));
+        std::memcpy(d.data() + h.index,index.data(),index.size() * sizeof(std::uint32_t));
+        d.insert(d.end(),keys.begin(),keys.end());
+        d.insert(d.end(),values.begin(),values.end());
+        writeFile(path,d);
+    }
+
+    void MibSnapshot::write(const std::string& path,const MibRegistry& mib)
+    {
+        std::vector<Varbind> vbs;
+        Varbind vb;
+        Oid oid;
+        // Stops should a handler not move forward.
+        while(mib.getNext(oid,vb) && oid < vb.getOid())
+        {
+            oid = vb.getOid();
+            vbs.push_back(vb);
+        }
+        write(path,std::move(vbs));
+    }
+}
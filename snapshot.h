@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <optional>
+#include <atomic>
+#include <shared_mutex>
+#include "snmp.h"
+#include "mib.h"
+
+namespace snmp
+{
+    // Populated MIB saved to a file and served straight from a read only
+    // mapping of it, so that a large agent answers as soon as the file is
+    // open instead of after registering and encoding every instance again.
+    // The file holds the instances sorted by oid, each as its encoded
+    // varbind, under an order preserving key of the oid; a prefix index over
+    // the first key bytes narrows the binary search of Get and GetNext.
+    // Values changed since the snapshot was written are kept in an overlay
+    // that takes precedence over the file. Safe to share between threads;
+    // register it with MibRegistry::addSubtree at a prefix of all of its
+    // instances, or at the root, Oid().
+    class MibSnapshot : public MibHandler
+    {
+    public:
+        // Maps the file written by write(). Throws std::system_error if it
+        // cannot be mapped and std::runtime_error if it is not a snapshot.
+        explicit MibSnapshot(const std::string& path);
+        ~MibSnapshot();
+        MibSnapshot(const MibSnapshot&) = delete;
+        MibSnapshot& operator=(const MibSnapshot&) = delete;
+        // Writes the instances of vbs, in any order; of equal oids the last
+        // one is kept. The file is replaced only once it is complete. Throws
+        // std::system_error, or Except::bad_oid for oids longer than
+        // max_subidentifiers.
+        static void write(const std::string& path,std::vector<Varbind> vbs);
+        // Writes every instance mib serves, as walked by getNext.
+        static void write(const std::string& path,const MibRegistry& mib);
+        bool get(const Oid& oid,Varbind& vb);
+        bool getNext(const Oid& oid,Varbind& vb);
+        // Live updates: set adds or replaces the instance of vb.getOid(),
+        // erase hides oid, whether it is in the file or was set.
+        void set(const Varbind& vb);
+        void erase(const Oid& oid);
+        // Instances in the file and updates in the overlay.
+        size_t size() const { return count; }
+        size_t getOverlaySize() const { return overlay_size.load(std::memory_order_relaxed); }
+        enum { max_subidentifiers = 128 };
+    private:
+        enum { max_key = max_subidentifiers * 5 };
+        struct Header;
+        struct Entry;
+        typedef std::map<std::string,std::optional<Varbind>,std::less<>> Overlay;
+        static size_t key(const Oid& oid,std::uint8_t* k);
+        std::string_view key(size_t i) const;
+        size_t find(std::string_view k,bool next) const;
+        bool value(size_t i,Varbind& vb) const;
+        const std::uint8_t* data;
+        size_t length;
+        const Entry* entries;
+        const std::uint32_t* index;
+        const std::uint8_t* keys;
+        const std::uint8_t* values;
+        size_t count;
+        size_t prefix_length;
+        size_t index_bytes;
+        mutable std::shared_mutex overlay_mutex;
+        Overlay overlay;
+        std::atomic<size_t> overlay_size;
+    };
+}
@@ -18,15 +18,27 @@
 #include <algorithm>
 #include <bitset>
 #include <typeinfo>
-#include <sstream>
+#include <charconv>
 #include <iterator>
 #include <cassert>
+#include <cstring>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "snmp.h"
 
 namespace snmp
 {
 
-    Except::Except(const Abstract* _id,Code code) throw() : str(typeid(*_id).name())
+    Except::Except(const Abstract* _id,Code _code) throw() : str(typeid(*_id).name()), code(_code)
+    {
+		str += ":";
+		str += message[code]; 
+    }
+
+    Except::Except(const char* _id,Code _code) throw() : str(_id), code(_code)
     {
 		str += ":";
 		str += message[code]; 
@@ -37,7 +49,87 @@ namespace snmp
 		return str.c_str();
 	}
     
-	const std::string Except::message[3] = {"Bad type","Protocol error","Incorrect OID"};
+	const std::string Except::message[5] = {"Bad type","Protocol error","Incorrect OID","Buffer too small","Out of memory"};
+
+    // Number of content bytes used for an unsigned value (Integer, Counter,
+    // Gauge, TimeTicks).
+    static size_t unsignedLength(std::uint32_t v)
+    {
+        if(v <= 0xff)
+            return 1;
+        else if(v <= 0xffff)
+            return 2;
+        else if(v <= 0xffffff)
+            return 3;
+        else
+            return 4;
+    }
+
+    // Number of base 128 bytes used for an OID subidentifier.
+    static size_t subidentifierLength(std::uint64_t v)
+    {
+        if(v <= 0x7f)
+            return 1;
+        else if(v <= 0x3fff)
+            return 2;
+        else if(v <= 0x1fffff)
+            return 3;
+        else if(v <= 0xfffffff)
+            return 4;
+        else
+            return 5;
+    }
+
+    Except::Except(const Status& status) throw() : str(status.element->name()), code(status.code)
+    {
+		str += ":";
+		str += message[status.code]; 
+    }
+
+    const std::uint8_t* Abstract::read(const std::uint8_t* b,const std::uint8_t* e,Status& status) noexcept
+    {
+        const std::uint8_t* r = 0;
+        status = Status();
+        try
+        {
+            r = decode(b,e,status);
+        }
+        catch(const Except& ex)
+        {
+            r = fail(status,b,ex.getCode());
+        }
+        catch(...)
+        {
+            // Allocating the decoded values is all that can throw otherwise.
+            r = fail(status,b,Except::no_memory);
+        }
+        if(r == 0)
+            status.offset = status.position - b;
+        return r;
+    }
+
+    const std::uint8_t* Abstract::read(const std::uint8_t* b,const std::uint8_t* e)
+    {
+        Status status;
+        b = read(b,e,status);
+        if(b == 0)
+            throw Except(status);
+        return b;
+    }
+
+    const std::uint8_t* Abstract::fail(Status& status,const std::uint8_t* at,Except::Code code) const
+    {
+        status.element = &typeid(*this);
+        status.code = code;
+        status.position = at;
+        return 0;
+    }
+
+    std::vector<std::uint8_t>::const_iterator Abstract::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    {
+        const std::uint8_t* p = (b != e) ? &*b : 0;
+        return b + (read(p,p + (e - b)) - p);
+    }
 
     MultibyteLen::MultibyteLen(std::uint32_t val) : value(val) 
     {
@@ -58,13 +150,13 @@ namespace snmp
         {
             _size = 4;
         }
-        else if(value <= 0xffffff)
+        else
         {
             _size = 5;
         }
     }
 
-    std::vector<std::uint8_t>::const_iterator MultibyteLen::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* MultibyteLen::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
         if(e - b >= 1)
         {
@@ -77,7 +169,7 @@ namespace snmp
                 b0.reset(7);
                 l = std::uint8_t(b0.to_ulong());
                 if(l > sizeof(value) || l > e - b)
-                    throw Except(this,Except::proto_error);
+                    return fail(status,b,Except::proto_error);
                 std::reverse_copy(b,b+l,reinterpret_cast<std::uint8_t*>(&value));
                 b += l;
                 _size = 1 + l;
@@ -89,7 +181,7 @@ namespace snmp
             }
         }
         else
-            throw Except(this,Except::proto_error);
+            return fail(status,b,Except::proto_error);
         return  b;
     }
 
@@ -110,49 +202,26 @@ namespace snmp
 
     MultibyteValue::MultibyteValue(std::uint64_t val) : value(val) 
     {
-        if(value <= 0x7f)
-        {
-            _size = 1;
-        }
-        else if(value <= 0x3fff)
-        {
-            _size = 2;
-        }
-        else if(value <= 0x3fffff)
-        {
-            _size = 3;
-        }
-        else if(value <= 0x3fffff)
-        {
-            _size = 4;
-        }
-        else if(value <= 0x3fffffff)
-        {
-            _size = 5;
-        }
+        _size = subidentifierLength(value);
     }
 
-    std::vector<std::uint8_t>::const_iterator MultibyteValue::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* MultibyteValue::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
         _size = 0;
+        value = 0;
         bool is_set(false);
-        std::vector<std::uint8_t> tmp;
         do
         {
             if(e - b < 1)
-                throw Except(this,Except::proto_error);
-            std::bitset<8> b0(*b);
-            is_set = b0[7];
-            b0.reset(7);
-            tmp.push_back(b0.to_ulong());
+                return fail(status,b,Except::proto_error);
+            is_set = *b & 0x80;
+            // Over-long: zero padded or past what any caller can hold.
+            if((_size == 0 && *b == 0x80) || _size == 9)
+                return fail(status,b,Except::proto_error);
+            value = (value * 128) + (*b & 0x7f);
             _size++;
             b++;
         } while(is_set);
-        value = 0;
-        for(std::vector<std::uint8_t>::const_iterator i = tmp.begin();i != tmp.end();i++)
-        {
-            value = (value * 128) + *i;
-        }
         return  b;
     }
 
@@ -204,19 +273,20 @@ namespace snmp
         }
     }
 
-    std::vector<std::uint8_t>::const_iterator Middle::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* Middle::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
         if(e - b > 1)
         {
             type = *b;
             b++;
-            b = length.read(b,e);
+            if((b = length.decode(b,e,status)) == 0)
+                return 0;
             _size = 1 + length.getSize();
             if(length > size_t(e - b))
-                throw Except(this,Except::proto_error);
+                return fail(status,b,Except::proto_error);
         }
         else
-            throw Except(this,Except::proto_error);
+            return fail(status,b,Except::proto_error);
         return b;
     }
 
@@ -226,9 +296,9 @@ namespace snmp
         length.write(d);
     }
 
-    std::vector<std::uint8_t>::const_iterator Primitive::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* Primitive::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
-        return Middle::read(b,e);
+        return Middle::decode(b,e,status);
     }
         
     void Primitive::write(std::vector<std::uint8_t>& d) const
@@ -236,13 +306,14 @@ namespace snmp
         Middle::write(d);
     }
 
-    std::vector<std::uint8_t>::const_iterator Null::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* Null::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
-        b = Primitive::read(b,e);
-        if(type != tnull)
-            throw Except(this,Except::bad_type);
+        if((b = Primitive::decode(b,e,status)) == 0)
+            return 0;
+        if(type != tnull && type != tno_such_object && type != tno_such_instance && type != tend_of_mib_view)
+            return fail(status,b,Except::bad_type);
         if(length != 0)
-            throw Except(this,Except::proto_error);
+            return fail(status,b,Except::proto_error);
         _size = 2;
         return b;
     }
@@ -255,29 +326,27 @@ namespace snmp
     Integer::Integer(int32_t val)
     {
         type = tinteger;
-        if((std::uint32_t)val <= 0xff)
-            length = 1;
-        else if((std::uint32_t)val <= 0xffff)
-            length = 2;
-        else if((std::uint32_t)val <= 0xffffff)
-            length = 3;
-        else
-            length = 4;
+        length = unsignedLength(val);
         value = val;
         _size = sizeof(type) + length.getSize() + length;
     }
 
-    std::vector<std::uint8_t>::const_iterator Integer::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* Integer::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
-        b = Primitive::read(b,e);
+        if((b = Primitive::decode(b,e,status)) == 0)
+            return 0;
         if(type != tinteger)
-            throw Except(this,Except::bad_type);
+            return fail(status,b,Except::bad_type);
         value = 0;
         if(e - b >= (int32_t)length && length <= sizeof(value))
         {
             std::reverse_copy(b,b+length,reinterpret_cast<std::uint8_t*>(&value));
             b = b+length;
         }
+        else
+        {
+            return fail(status,b,Except::proto_error);
+        }
         _size += length;
         return b;
     }
@@ -291,23 +360,17 @@ namespace snmp
     Counter::Counter(std::uint32_t val)
     {
         type = tcounter;
-        if(val <= 0xff)
-            length = 1;
-        else if(val <= 0xffff)
-            length = 2;
-        else if(val <= 0xffffff)
-            length = 3;
-        else
-            length = 4;
+        length = unsignedLength(val);
         value = val;
         _size = sizeof(type) + length.getSize() + length;
     }
 
-    std::vector<std::uint8_t>::const_iterator Counter::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* Counter::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
-        b = Primitive::read(b,e);
+        if((b = Primitive::decode(b,e,status)) == 0)
+            return 0;
         if(type != tcounter)
-            throw Except(this,Except::bad_type);
+            return fail(status,b,Except::bad_type);
         value = 0;
         if(e - b >= (int32_t)length)
         {
@@ -321,7 +384,7 @@ namespace snmp
         }
         else
         {
-            throw Except(this,Except::proto_error);
+            return fail(status,b,Except::proto_error);
         }
         _size += length;
         return b;
@@ -337,23 +400,17 @@ namespace snmp
     Gauge::Gauge(std::uint32_t val)
     {
         type = tgauge;
-        if(val <= 0xff)
-            length = 1;
-        else if(val <= 0xffff)
-            length = 2;
-        else if(val <= 0xffffff)
-            length = 3;
-        else
-            length = 4;
+        length = unsignedLength(val);
         value = val;
         _size = sizeof(type) + length.getSize() + length;
     }
 
-    std::vector<std::uint8_t>::const_iterator Gauge::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* Gauge::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
-        b = Primitive::read(b,e);
+        if((b = Primitive::decode(b,e,status)) == 0)
+            return 0;
         if(type != tgauge)
-            throw Except(this,Except::bad_type);
+            return fail(status,b,Except::bad_type);
         value = 0;
         if(e - b >= (int32_t)length)
         {
@@ -367,7 +424,7 @@ namespace snmp
         }
         else
         {
-            throw Except(this,Except::proto_error);
+            return fail(status,b,Except::proto_error);
         }
         _size += length;
         return b;
@@ -382,22 +439,32 @@ namespace snmp
     TimeTicks::TimeTicks(std::uint32_t v)
     {
         type = ttime_ticks;
-        length = 3;
+        length = unsignedLength(v);
         value = v;
         _size = sizeof(type) + length.getSize() + length;
     }
 
-    std::vector<std::uint8_t>::const_iterator TimeTicks::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* TimeTicks::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
-        b = Primitive::read(b,e);
+        if((b = Primitive::decode(b,e,status)) == 0)
+            return 0;
         if(type != ttime_ticks)
-            throw Except(this,Except::bad_type);
+            return fail(status,b,Except::bad_type);
         value = 0;
-        if(e - b >= (int)length && length <= sizeof(value))
+        if(e - b >= (int32_t)length)
         {
-            std::reverse_copy(b,b+length,reinterpret_cast<std::uint8_t*>(&value));
+            size_t shift;
+            if(length > sizeof(value))
+                shift = length - sizeof(value);
+            else
+                shift = 0;
+            std::reverse_copy(b+shift,b+length,reinterpret_cast<std::uint8_t*>(&value));
             b = b+length;
         }
+        else
+        {
+            return fail(status,b,Except::proto_error);
+        }
         _size += length;
         return b;
     }
@@ -443,19 +510,19 @@ namespace snmp
         setValue(val);
     }
 
-    std::vector<std::uint8_t>::const_iterator OctetString::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* OctetString::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
-        b = Primitive::read(b,e);
+        if((b = Primitive::decode(b,e,status)) == 0)
+            return 0;
         if(type != tocted_string)
-            throw Except(this,Except::bad_type);
+            return fail(status,b,Except::bad_type);
         if(e - b >= (int)length)
         {
-            value.clear();
-            std::copy(b,b+length,std::inserter(value,value.end()));
+            value.assign(b,b+length);
             b = b+length;
         }
         else
-            throw Except(this,Except::proto_error);
+            return fail(status,b,Except::proto_error);
         _size += length;
         return b;
     }
@@ -468,20 +535,64 @@ namespace snmp
 
     std::string OctetString::getValue() const
     {
-        return value;
+        return std::string(value.data(),value.size());
     }
 
     void OctetString::setValue(const std::string& str)
     {
         type = tocted_string;
-        value = str;
+        value.assign(str.data(),str.size());
         length = value.size();
-        _size = 2 + length;
+        _size = 1 + length.getSize() + length;
+    }
+
+    IpAddress::IpAddress(std::uint32_t v)
+    {
+        type = tip_address;
+        length = 4;
+        value = v;
+        _size = 6;
     }
 
-    std::vector<std::uint8_t>::const_iterator Unknow::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    std::string IpAddress::asString() const
     {
-        b = Primitive::read(b,e);
+        // Four octets of up to three digits and three dots. The bound on the
+        // dots never trips, but it lets the compiler see they stay inside.
+        char str[16];
+        char* p = str;
+        for(int shift = 24;shift >= 0;shift -= 8)
+        {
+            p = std::to_chars(p,str + sizeof(str),(value >> shift) & 0xff).ptr;
+            if(shift > 0 && p < str + sizeof(str))
+                *p++ = '.';
+        }
+        return std::string(str,p);
+    }
+
+    const std::uint8_t* IpAddress::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
+    {
+        if((b = Primitive::decode(b,e,status)) == 0)
+            return 0;
+        if(type != tip_address)
+            return fail(status,b,Except::bad_type);
+        if(length != 4)
+            return fail(status,b,Except::proto_error);
+        value = std::uint32_t(b[0]) << 24 | std::uint32_t(b[1]) << 16 | std::uint32_t(b[2]) << 8 | b[3];
+        _size += 4;
+        return b + 4;
+    }
+
+    void IpAddress::write(std::vector<std::uint8_t>& d) const
+    {
+        Primitive::write(d);
+        for(int shift = 24;shift >= 0;shift -= 8)
+            d.push_back((value >> shift) & 0xff);
+    }
+
+    const std::uint8_t* Unknow::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
+    {
+        if((b = Primitive::decode(b,e,status)) == 0)
+            return 0;
         _size += length;
         return (b + length);
     }
@@ -492,9 +603,9 @@ namespace snmp
         d.insert(d.end(),length.getValue(),0);
     }
 
-    std::vector<std::uint8_t>::const_iterator Complex::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* Complex::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
-        return Middle::read(b,e);
+        return Middle::decode(b,e,status);
     }
     
     void Complex::write(std::vector<std::uint8_t>& d) const
@@ -502,123 +613,310 @@ namespace snmp
         Middle::write(d);
     }
     
-    Oid::Oid(const std::uint32_t *oid, size_t n)
+    Oid::Oid(const std::uint32_t *oid, size_t n) : value(buffer), count(0), capacity(inline_size), resource(std::pmr::get_default_resource())
     {
         type = tobject_identifier;
-        value.push_back(0x2b);
-        length = length + value.back().getSize();
+        reserve(n);
+        append(0x2b);
         for(size_t i = 2;i < n;i++)
         {
-            value.push_back(oid[i]);
-            length = length + value.back().getSize();
+            append(oid[i]);
         }
-        _size = 2 + length;
+        _size = 1 + length.getSize() + length;
     }
     
-    Oid::Oid(const std::string& oid)
+    Oid::Oid(std::string_view oid) : value(buffer), count(0), capacity(inline_size), resource(std::pmr::get_default_resource())
     {
         type = tobject_identifier;
-        std::uint32_t v,v1,v3; char z;
-        std::istringstream s(oid);
-        s >> v1 >> z >> v3 >> z;
-        if(v1 != 1 || v3 != 3)
+        // "1.3" followed by any number of ".arc", arcs being decimal 32 bit
+        // integers; 1.3 is stored as its combined subidentifier 0x2b.
+        const char* p = oid.data();
+        const char* e = p + oid.size();
+        if(oid.size() < 3 || p[0] != '1' || p[1] != '.' || p[2] != '3')
             throw Except(this,Except::bad_oid);
-        value.push_back(0x2b);
-        length = length + value.back().getSize();
-        while(true)
+        append(0x2b);
+        for(p += 3;p != e;)
         {
-            if(s >> v)
+            std::uint32_t v;
+            std::from_chars_result r;
+            if(*p != '.' || (r = std::from_chars(p + 1,e,v)).ec != std::errc())
             {
-                value.push_back(v);
-                length = length + value.back().getSize();
+                release();
+                throw Except(this,Except::bad_oid);
             }
-            if(s >> z)
+            append(v);
+            p = r.ptr;
+        }
+        _size = 1 + length.getSize() + length;
+    }
+
+    Oid::Oid(const Oid& oid) : Primitive(oid), value(buffer), count(0), capacity(inline_size), resource(std::pmr::get_default_resource())
+    {
+        reserve(oid.count);
+        std::copy(oid.value,oid.value + oid.count,value);
+        count = oid.count;
+    }
+
+    Oid::Oid(Oid&& oid) : Primitive(oid), value(buffer), count(0), capacity(inline_size), resource(oid.resource)
+    {
+        *this = std::move(oid);
+    }
+
+    Oid::~Oid()
+    {
+        release();
+    }
+
+    Oid& Oid::operator=(const Oid& oid)
+    {
+        if(this != &oid)
+        {
+            Primitive::operator=(oid);
+            reserve(oid.count);
+            std::copy(oid.value,oid.value + oid.count,value);
+            count = oid.count;
+        }
+        return *this;
+    }
+
+    Oid& Oid::operator=(Oid&& oid)
+    {
+        if(this != &oid)
+        {
+            Primitive::operator=(oid);
+            if(oid.value != oid.buffer && resource->is_equal(*oid.resource))
             {
-                if(z != '.')
-                    throw Except(this,Except::bad_oid);
+                release();
+                value = oid.value;
+                capacity = oid.capacity;
+                oid.value = oid.buffer;
+                oid.capacity = inline_size;
             }
             else
-                break;
+            {
+                reserve(oid.count);
+                std::copy(oid.value,oid.value + oid.count,value);
+            }
+            count = oid.count;
+            oid.count = 0;
         }
-        _size = 2 + length;
+        return *this;
     }
 
-    std::vector<std::uint8_t>::const_iterator Oid::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    void Oid::reserve(size_t n)
     {
-        b = Primitive::read(b,e);
-        if(type != tobject_identifier)
-            throw Except(this,Except::bad_type);
-        size_t l=length;
-        MultibyteValue v;
-        value.clear();
-        while(l > 0)
+        if(n > capacity)
         {
-            b = v.read(b,e);
-            l -= v.getSize();
-            _size += v.getSize();
-            value.push_back(v);
+            std::uint32_t* p = static_cast<std::uint32_t*>(resource->allocate(n * sizeof(std::uint32_t),alignof(std::uint32_t)));
+            std::copy(value,value + count,p);
+            release();
+            value = p;
+            capacity = n;
         }
+    }
+
+    void Oid::release()
+    {
+        if(value != buffer)
+            resource->deallocate(value,capacity * sizeof(std::uint32_t),alignof(std::uint32_t));
+        value = buffer;
+        capacity = inline_size;
+    }
+
+    void Oid::append(std::uint32_t v)
+    {
+        if(count == capacity)
+            reserve(2 * capacity);
+        value[count++] = v;
+        length = length + subidentifierLength(v);
+    }
+
+    // Decodes the base-128 subidentifiers of [b,e) into out and adds the
+    // number found to count. Returns e, or the start of a subidentifier that
+    // is cut off or over-long: padded with a leading 0x80 (X.690 8.19.2) or
+    // wider than 32 bits.
+    static inline const std::uint8_t* subidentifiers(const std::uint8_t* b,const std::uint8_t* e,std::uint32_t* out,std::uint32_t& count)
+    {
+        while(b < e)
+        {
+            if(*b < 0x80)
+            {
+                out[count++] = *b++;
+                continue;
+            }
+            const std::uint8_t* first = b;
+            if(*b == 0x80)
+                return first;
+            std::uint32_t v = 0;
+            do
+            {
+                if(b == e || v > 0x1ffffff)
+                    return first;
+                v = (v << 7) | (*b & 0x7f);
+            } while(*b++ & 0x80);
+            out[count++] = v;
+        }
+        return b;
+    }
+
+    // Same as subidentifiers(), for a whole OID body; out must have room for
+    // e - b subidentifiers. The continuation bits of 16 bytes are gathered
+    // at once: a block of single byte subidentifiers, the usual case, is just
+    // widened, otherwise the block is decoded up to the end of the last
+    // subidentifier it completes and the rest starts the next one.
+    static const std::uint8_t* oidContents(const std::uint8_t* b,const std::uint8_t* e,std::uint32_t* out,std::uint32_t& count)
+    {
+#if defined(__SSE2__)
+        while(e - b >= 16)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+            unsigned more = _mm_movemask_epi8(bytes);
+            if(more == 0)
+            {
+                std::uint32_t* p = out + count;
+#if defined(__AVX2__)
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(p),_mm256_cvtepu8_epi32(bytes));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + 8),_mm256_cvtepu8_epi32(_mm_unpackhi_epi64(bytes,bytes)));
+#else
+                __m128i zero = _mm_setzero_si128();
+                __m128i lo = _mm_unpacklo_epi8(bytes,zero);
+                __m128i hi = _mm_unpackhi_epi8(bytes,zero);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p),_mm_unpacklo_epi16(lo,zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 4),_mm_unpackhi_epi16(lo,zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 8),_mm_unpacklo_epi16(hi,zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 12),_mm_unpackhi_epi16(hi,zero));
+#endif
+                count += 16;
+                b += 16;
+                continue;
+            }
+            // Bytes without the continuation bit end a subidentifier; 16
+            // bytes without one can only be an over-long subidentifier.
+            unsigned last = ~more & 0xffff;
+            if(last == 0)
+                return b;
+            const std::uint8_t* stop = b + 32 - __builtin_clz(last);
+            if((b = subidentifiers(b,stop,out,count)) != stop)
+                return b;
+        }
+#endif
+        return subidentifiers(b,e,out,count);
+    }
+
+    const std::uint8_t* Oid::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
+    {
+        if((b = Primitive::decode(b,e,status)) == 0)
+            return 0;
+        if(type != tobject_identifier)
+            return fail(status,b,Except::bad_type);
+        const std::uint8_t* end = b + length;
+        count = 0;
+        reserve(length);
+        if((b = oidContents(b,end,value,count)) != end)
+            return fail(status,b,Except::proto_error);
+        _size += length;
         return b;
     }
     
     void Oid::write(std::vector<std::uint8_t>& d) const
     {
         Primitive::write(d);
-        for(std::vector<MultibyteValue>::const_iterator i = value.begin();i != value.end();i++)
+        for(size_t i = 0;i < count;i++)
         {
-            i->write(d);
+            for(size_t n = subidentifierLength(value[i]) - 1;n > 0;n--)
+                d.push_back(0x80 | ((value[i] >> (7 * n)) & 0x7f));
+            d.push_back(value[i] & 0x7f);
         }
     }
     
     std::uint32_t Oid::getBack(size_t n) const
     {
         n = n + 1;
-        assert(value.size() >= n);
-        return value.at(value.size() - n).getValue();
+        assert(count >= n);
+        return value[count - n];
     }
     
     const std::uint32_t Oid::operator[](size_t n) const
     {
-            assert(value.size() > n);
-            return value.at(n).getValue(); 
+            assert(count > n);
+            return value[n]; 
+    }
+
+    char* Oid::format(char* first,char* last) const
+    {
+        if(count == 0)
+            return first;
+        // The first subidentifier holds the first two arcs (X.690 8.19.4).
+        std::uint32_t arc1 = value[0] < 80 ? value[0] / 40 : 2;
+        std::to_chars_result r = std::to_chars(first,last,arc1);
+        if(r.ec != std::errc() || r.ptr == last)
+            return 0;
+        *r.ptr++ = '.';
+        r = std::to_chars(r.ptr,last,value[0] - 40 * arc1);
+        for(size_t i = 1;i < count && r.ec == std::errc();i++)
+        {
+            if(r.ptr == last)
+                return 0;
+            *r.ptr++ = '.';
+            r = std::to_chars(r.ptr,last,value[i]);
+        }
+        return r.ec == std::errc() ? r.ptr : 0;
     }
 
     std::string Oid::asString() const
     {
-        std::ostringstream str;
-        for(std::vector<MultibyteValue>::const_iterator i = value.begin();i != value.end();i++)
+        std::string str(count * (max_arc_chars + 1),'\0');
+        char* p = str.data();
+        char* last = p + str.size();
+        for(size_t i = 0;i < count;i++)
         {
-            str << i->getValue();
-            if(i + 1 != value.end())
-                str << '.';
+            if(i != 0)
+                *p++ = '.';
+            p = std::to_chars(p,last,value[i]).ptr;
         }
-        return str.str();
+        str.resize(p - str.data());
+        return str;
     }
 
     Oid Oid::operator+(std::uint32_t v) const
     {
         Oid tmp(*this);
-        tmp.length = tmp.length + tmp.value.back().getSize();
-        tmp.value.push_back(v);
-        tmp._size = 2 + tmp.length;
+        tmp.append(v);
+        tmp._size = 1 + tmp.length.getSize() + tmp.length;
         return tmp;
     }
 
-    bool operator==(const Oid& oid1,const Oid& oid2)
+    size_t Oid::hash() const
     {
-        if(oid1.getType() == oid2.getType() && oid1.getValueSize() == oid2.getValueSize())
+        std::uint64_t h = 0xcbf29ce484222325ULL;
+        for(size_t i = 0;i < count;i++)
         {
-            for(size_t i = 0;i < oid1.getValueSize();i++)
-            {
-                if(oid1[i] != oid2[i])
-                {
-                    return false;
-                }
-            }
-            return true;
+            h = (h ^ value[i]) * 0x100000001b3ULL;
         }
-        else
-            return false;
+        return size_t(h ^ (h >> 32));
+    }
+
+    // Index of the first differing subidentifier, or n if the first n are equal.
+    static size_t mismatch(const std::uint32_t* a,const std::uint32_t* b,size_t n)
+    {
+        size_t i = 0;
+#if defined(__SSE2__)
+        for(;i + 4 <= n;i += 4)
+        {
+            __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+            unsigned mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+            if(mask != 0xf)
+                return i + __builtin_ctz(~mask);
+        }
+#endif
+        for(;i < n && a[i] == b[i];i++);
+        return i;
+    }
+
+    bool operator==(const Oid& oid1,const Oid& oid2)
+    {
+        return oid1.getType() == oid2.getType() && oid1.getValueSize() == oid2.getValueSize()
+            && std::memcmp(oid1.getValue(),oid2.getValue(),oid1.getValueSize() * sizeof(std::uint32_t)) == 0;
     }
     
     bool operator!=(const Oid& oid1,const Oid& oid2)
@@ -628,135 +926,113 @@ namespace snmp
     
     bool operator<(const Oid& oid1,const Oid& oid2)
     {
-        size_t len;
-        if(oid1.getValueSize() < oid2.getValueSize())
-        {
-            len = oid1.getValueSize();
-        }
-        else
-        {
-            len = oid2.getValueSize();
-        }
-        for(size_t i = 0;i < len;i++)
-        {
-            if(oid1[i] != oid2[i])
-            {
-                if(oid1[i] > oid2[i])
-                {
-                    return false;
-                }
-                return true;
-            }
-        }
-        if(oid1.getValueSize() < oid2.getValueSize())
-            return true;
-        else
-            return false;
-        
+        size_t len = std::min(oid1.getValueSize(),oid2.getValueSize());
+        size_t i = mismatch(oid1.getValue(),oid2.getValue(),len);
+        if(i < len)
+            return oid1.getValue()[i] < oid2.getValue()[i];
+        return oid1.getValueSize() < oid2.getValueSize();
     }
     
-    Varbind::Varbind(const Varbind& vb)
+    Varbind::Varbind(const Oid& _oid,const Integer& _int) : oid(_oid),value(_int)
     {
-        copy(vb);
+        setLength();
     }
 
-    Varbind::Varbind(const Oid& _oid,const Integer& _int) : integer(_int),value(&integer)
+    Varbind::Varbind(const Oid& _oid,const Counter& ct) : oid(_oid),value(ct)
     {
-        type = sequence;
-        length = _oid.getSize() + integer.getSize();
-        oid = _oid;
-        _size = 1 + length.getSize() + length;
+        setLength();
     }
 
-    Varbind::Varbind(const Oid& _oid,const Counter& ct) : counter(ct),value(&counter)
+    Varbind::Varbind(const Oid& _oid,const Gauge& ga) : oid(_oid),value(ga)
     {
-        type = sequence;
-        length = _oid.getSize() + counter.getSize();
-        oid = _oid;
-        _size = 1 + length.getSize() + length;
+        setLength();
     }
 
-    Varbind::Varbind(const Oid& _oid,const Gauge& ga) : gauge(ga),value(&gauge)
+    Varbind::Varbind(const Oid& _oid,const TimeTicks& tt) : oid(_oid),value(tt)
     {
-        type = sequence;
-        length = _oid.getSize() + counter.getSize();
-        oid = _oid;
-        _size = 1 + length.getSize() + length;
+        setLength();
     }
 
-    Varbind::Varbind(const Oid& _oid,const TimeTicks& tt) : time_ticks(tt),value(&time_ticks)
+    Varbind::Varbind(const Oid& _oid,const OctetString& os) : oid(_oid),value(os)
     {
-        type = sequence;
-        length = _oid.getSize() + time_ticks.getSize();
-        oid = _oid;
-        _size = 1 + length.getSize() + length;
+        setLength();
     }
-
-    Varbind::Varbind(const Oid& _oid,const OctetString& os) : octet_string(os),value(&octet_string)
+    
+    Varbind::Varbind(const Oid& _oid,const Oid& _oidv) : oid(_oid),value(_oidv)
     {
-        type = sequence;
-        length = _oid.getSize() + os.getSize();
-        oid = _oid;
-        _size = 1 + length.getSize() + length;
+        setLength();
     }
     
-    Varbind::Varbind(const Oid& _oid,const Oid& _oidv) : oidv(_oidv),value(&oidv)
+    Varbind::Varbind(const Oid& _oid,const IpAddress& ip) : oid(_oid),value(ip)
     {
-        type = sequence;
-        length = _oid.getSize() + oidv.getSize();
-        oid = _oid;
-        _size = 1 + length.getSize() + length;
+        setLength();
     }
-    
-    Varbind::Varbind(const Oid& _oid) : value(&null)
+
+    Varbind::Varbind(const Oid& _oid) : oid(_oid)
+    {
+        setLength();
+    }
+
+    Varbind::Varbind(const Oid& _oid,const Null& n) : oid(_oid),value(n)
+    {
+        setLength();
+    }
+
+    void Varbind::setLength()
     {
         type = sequence;
-        length = _oid.getSize() + null.getSize();
-        oid = _oid;
+        length = oid.getSize() + getValue().getSize();
         _size = 1 + length.getSize() + length;
     }
 
-    std::vector<std::uint8_t>::const_iterator Varbind::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* Varbind::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
-        b = Complex::read(b,e);
+        encoded.reset();
+        if((b = Complex::decode(b,e,status)) == 0)
+            return 0;
         if(type != sequence)
-            throw Except(this,Except::bad_type);
-        b = oid.read(b,e);
+            return fail(status,b,Except::bad_type);
+        if((b = oid.decode(b,e,status)) == 0)
+            return 0;
         _size += oid.getSize();
-        if(*b == Primitive::ttime_ticks)
-        {
-            value = &time_ticks;
-        }
-        else if(*b == Primitive::tinteger)
-        {
-            value = &integer;
-        }
-        else if(*b == Primitive::tcounter)
-        {
-            value = &counter;
-        }
-        else if(*b == Primitive::tgauge)
-        {
-            value = &gauge;
-        }
-        else if(*b == Primitive::tocted_string)
-        {
-            value = &octet_string;
-        }
-        else if(*b == Primitive::tobject_identifier)
-        {
-            value = &oidv;
-        }
-        else if(*b == Primitive::tnull)
-        {
-            value = &null;
-        }
-        else
+        if(b == e)
+            return fail(status,b,Except::proto_error);
+        switch(*b)
         {
-            value = &unknow;
+        case Primitive::ttime_ticks:
+            value.emplace<TimeTicks>();
+            break;
+        case Primitive::tinteger:
+            value.emplace<Integer>();
+            break;
+        case Primitive::tcounter:
+            value.emplace<Counter>();
+            break;
+        case Primitive::tgauge:
+            value.emplace<Gauge>();
+            break;
+        case Primitive::tocted_string:
+            value.emplace<OctetString>(oid.getResource());
+            break;
+        case Primitive::tobject_identifier:
+            value.emplace<Oid>(oid.getResource());
+            break;
+        case Primitive::tip_address:
+            value.emplace<IpAddress>();
+            break;
+        case Primitive::tnull:
+        case Primitive::tno_such_object:
+        case Primitive::tno_such_instance:
+        case Primitive::tend_of_mib_view:
+            value.emplace<Null>();
+            break;
+        default:
+            value.emplace<Unknow>();
+            break;
         }
-        b = value->read(b,e);
-        _size += value->getSize();
+        if((b = std::visit([b,e,&status](auto& v) { return v.decode(b,e,status); },value)) == 0)
+            return 0;
+        _size += getValue().getSize();
         return b;
     }
     
@@ -764,108 +1040,78 @@ namespace snmp
     {
         Complex::write(d);
         oid.write(d);
-        value->write(d);
+        std::visit([&d](const auto& v) { v.write(d); },value);
     }
     
     std::uint8_t Varbind::getValueType() const
     {
-        return value->getType();
+        return getValue().getType();
     }
         
     const Primitive& Varbind::getValue() const
     {
-        return *value;
+        return std::visit([](const Primitive& v) -> const Primitive& { return v; },value);
     }
 
-    Varbind& Varbind::operator=(const Varbind& vb)
-    {
-        copy(vb);
-        return *this;
-    }
-
-    void Varbind::copy(const Varbind& vb)
+    Varbinds::Varbinds()
     {
-        type = vb.type;
-        length = vb.length;
-        oid = vb.oid;
-        if(vb.getValueType() == Primitive::tinteger)
-        {
-            integer = vb.integer;
-            value = &integer;
-        }
-        else if(vb.getValueType() == Primitive::tcounter)
-        {
-            counter = vb.counter;
-            value = &counter;
-        }
-        else if(vb.getValueType() == Primitive::tgauge)
-        {
-            gauge = vb.gauge;
-            value = &gauge;
-        }
-        else if(vb.getValueType() == Primitive::ttime_ticks)
-        {
-            time_ticks = vb.time_ticks;
-            value = &time_ticks;
-        }
-        else if(vb.getValueType() == Primitive::tocted_string)
-        {
-            octet_string = vb.octet_string;
-            value = &octet_string;
-        }
-        else if(vb.getValueType() == Primitive::tobject_identifier)
-        {
-            oidv = vb.oidv;
-            value = &oidv;
-        }
-        else if(vb.getValueType() == Primitive::tnull)
-        {
-            null = vb.null;
-            value = &null;
-        }
-        else
-        {
-            unknow = vb.unknow;
-            value = &unknow;
-        }
-        _size = vb._size;
+        type = sequence;
+        length = 0;
+        _size = 2;
     }
 
-    Varbinds::Varbinds()
+    Varbinds::Varbinds(std::pmr::memory_resource* resource) : value(resource)
     {
         type = sequence;
         length = 0;
-        _size = 0;
+        _size = 2;
     }
 
     void Varbinds::addVarbind(const Varbind& vb)
     {
         value.push_back(vb);
-        length = length + vb.getSize();
-        _size = 1 + length.getSize();
-        for(std::list<Varbind>::const_iterator i = value.begin();i != value.end();i++)
-        {
-            _size += i->getSize();
-        }
+        added();
+    }
+
+    void Varbinds::addVarbind(Varbind&& vb)
+    {
+        value.push_back(std::move(vb));
+        added();
+    }
+
+    void Varbinds::added()
+    {
+        length = length + value.back().getSize();
+        _size = 1 + length.getSize() + length;
     }
 
-    std::vector<std::uint8_t>::const_iterator Varbinds::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    const std::uint8_t* Varbinds::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
     {
-        b = Complex::read(b,e);
+        if((b = Complex::decode(b,e,status)) == 0)
+            return 0;
         if(type != sequence)
-            throw Except(this,Except::bad_type);
+            return fail(status,b,Except::bad_type);
 
+        // Count the entries first so the array is allocated once, which
+        // matters when it comes from a monotonic arena.
+        size_t n = 0;
+        Middle tlv;
+        for(const std::uint8_t* p = b;p < b + length;n++)
+        {
+            if((p = tlv.decode(p,b + length,status)) == 0)
+                return 0;
+            p += tlv.getLength();
+        }
         size_t len_tmp=0;
-        if(length > 0)
+        value.clear();
+        value.reserve(n);
+        while(len_tmp < length)
         {
-            Varbind varbind;
-            while(len_tmp < length)
-            {
-                b = varbind.read(b,e);
-                _size += varbind.getSize();
-                len_tmp += varbind.getSize();
-                value.push_back(varbind);
-            }
+            value.emplace_back(value.get_allocator().resource());
+            if((b = value.back().decode(b,e,status)) == 0)
+                return 0;
+            _size += value.back().getSize();
+            len_tmp += value.back().getSize();
         }
         return b;
     }
@@ -873,9 +1119,9 @@ namespace snmp
     void Varbinds::write(std::vector<std::uint8_t>& d) const
     {
         Complex::write(d);
-        for(std::list<Varbind>::const_iterator i = value.begin();i != value.end();i++)
+        for(size_t i = 0;i < value.size();i++)
         {
-            i->write(d);
+            value[i].write(d);
         }
     }
     
@@ -891,18 +1137,24 @@ namespace snmp
     }
     
     
-    std::vector<std::uint8_t>::const_iterator PDU::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
-    {
-        b = Complex::read(b,e);
-        if(type != get_request && type != get_next_request && type != get_response && type != set_request)
-            throw Except(this,Except::bad_type);
-        b = request_id.read(b,e);
+    const std::uint8_t* PDU::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
+    {
+        if((b = Complex::decode(b,e,status)) == 0)
+            return 0;
+        if(type != get_request && type != get_next_request && type != get_response && type != set_request && type != get_bulk_request &&
+            type != inform_request && type != snmpv2_trap)
+            return fail(status,b,Except::bad_type);
+        if((b = request_id.decode(b,e,status)) == 0)
+            return 0;
         _size += request_id.getSize();
-        b = error.read(b,e);
+        if((b = error.decode(b,e,status)) == 0)
+            return 0;
         _size += error.getSize();
-        b = error_id.read(b,e);
+        if((b = error_id.decode(b,e,status)) == 0)
+            return 0;
         _size += error_id.getSize();
-        b = varbinds.read(b,e);
+        if((b = varbinds.decode(b,e,status)) == 0)
+            return 0;
         _size += varbinds.getSize();
         return b;
     }
@@ -916,7 +1168,58 @@ namespace snmp
         varbinds.write(d);
     }
 
-    Message::Message(const Integer& ver,const OctetString& comm)
+    TrapPDU::TrapPDU(const Oid& ent,const IpAddress& addr,const Integer& gen,const Integer& spec,const TimeTicks& ts,const Varbinds& vs)
+    {
+        type = trap;
+        enterprise = ent;
+        agent_addr = addr;
+        generic_trap = gen;
+        specific_trap = spec;
+        time_stamp = ts;
+        varbinds = vs;
+        length = enterprise.getSize() + agent_addr.getSize() + generic_trap.getSize() + specific_trap.getSize() + time_stamp.getSize() + varbinds.getSize();
+        _size = 1 + length.getSize() + length;
+    }
+
+    const std::uint8_t* TrapPDU::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
+    {
+        if((b = Complex::decode(b,e,status)) == 0)
+            return 0;
+        if(type != trap)
+            return fail(status,b,Except::bad_type);
+        if((b = enterprise.decode(b,e,status)) == 0)
+            return 0;
+        _size += enterprise.getSize();
+        if((b = agent_addr.decode(b,e,status)) == 0)
+            return 0;
+        _size += agent_addr.getSize();
+        if((b = generic_trap.decode(b,e,status)) == 0)
+            return 0;
+        _size += generic_trap.getSize();
+        if((b = specific_trap.decode(b,e,status)) == 0)
+            return 0;
+        _size += specific_trap.getSize();
+        if((b = time_stamp.decode(b,e,status)) == 0)
+            return 0;
+        _size += time_stamp.getSize();
+        if((b = varbinds.decode(b,e,status)) == 0)
+            return 0;
+        _size += varbinds.getSize();
+        return b;
+    }
+
+    void TrapPDU::write(std::vector<std::uint8_t>& d) const
+    {
+        Complex::write(d);
+        enterprise.write(d);
+        agent_addr.write(d);
+        generic_trap.write(d);
+        specific_trap.write(d);
+        time_stamp.write(d);
+        varbinds.write(d);
+    }
+
+    Message::Message(const Integer& ver,const OctetString& comm) : pdu_type(0)
     {
         set(ver,comm);
     }
@@ -933,22 +1236,45 @@ namespace snmp
     void Message::setPDU(const PDU& _pdu)
     {
         pdu = _pdu;
+        pdu_type = pdu.getType();
         length = version.getSize() + community.getSize();
         length = length + pdu.getSize();
         _size = 1 + length.getSize() + length;
-        _size += pdu.getSize();
     }
 
-    std::vector<std::uint8_t>::const_iterator Message::read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e)
+    void Message::setTrap(const TrapPDU& _trap)
     {
-        b = Complex::read(b,e);
+        trap_pdu = _trap;
+        pdu_type = trap_pdu.getType();
+        length = version.getSize() + community.getSize();
+        length = length + trap_pdu.getSize();
+        _size = 1 + length.getSize() + length;
+    }
+
+    const std::uint8_t* Message::decode(const std::uint8_t* b,const std::uint8_t* e,Status& status)
+    {
+        if((b = Complex::decode(b,e,status)) == 0)
+            return 0;
         if(type != sequence)
-            throw Except(this,Except::bad_type);
-        b = version.read(b,e);
+            return fail(status,b,Except::bad_type);
+        if((b = version.decode(b,e,status)) == 0)
+            return 0;
         _size += version.getSize();
-        b = community.read(b,e);
+        if((b = community.decode(b,e,status)) == 0)
+            return 0;
         _size += community.getSize();
-        b = pdu.read(b,e);
+        if(b == e)
+            return fail(status,b,Except::proto_error);
+        pdu_type = *b;
+        if(pdu_type == Complex::trap)
+        {
+            if((b = trap_pdu.decode(b,e,status)) == 0)
+                return 0;
+            _size += trap_pdu.getSize();
+            return b;
+        }
+        if((b = pdu.decode(b,e,status)) == 0)
+            return 0;
         _size += pdu.getSize();
         return b;
     }
@@ -959,7 +1285,561 @@ namespace snmp
         Complex::write(d);
         version.write(d);
         community.write(d);
-        pdu.write(d);
+        if(pdu_type == Complex::trap)
+            trap_pdu.write(d);
+        else
+            pdu.write(d);
+    }
+
+    static const std::uint8_t* failHeader(const Middle& tlv,const std::uint8_t* at,Except::Code code,Status& status)
+    {
+        status.element = &typeid(tlv);
+        status.code = code;
+        status.position = at;
+        return 0;
+    }
+
+    // Reads the TLV header at b and returns the start of its contents, or 0
+    // if it is malformed or not of the given type.
+    static const std::uint8_t* readHeader(Middle& tlv,const std::uint8_t* b,const std::uint8_t* e,std::uint8_t type,Status& status)
+    {
+        const std::uint8_t* p = tlv.decode(b,e,status);
+        if(p != 0 && tlv.getType() != type)
+            return failHeader(tlv,b,Except::bad_type,status);
+        return p;
+    }
+
+    MessageView::MessageView(const std::uint8_t* b,const std::uint8_t* e)
+    {
+        read(b,e);
+    }
+
+    const std::uint8_t* MessageView::read(const std::uint8_t* b,const std::uint8_t* e,Status& status) noexcept
+    {
+        const std::uint8_t* r = 0;
+        status = Status();
+        try
+        {
+            r = parse(b,e,status);
+        }
+        catch(const Except& ex)
+        {
+            r = failHeader(Middle(),b,ex.getCode(),status);
+        }
+        catch(...)
+        {
+            r = failHeader(Middle(),b,Except::no_memory,status);
+        }
+        if(r == 0)
+            status.offset = status.position - b;
+        return r;
+    }
+
+    const std::uint8_t* MessageView::read(const std::uint8_t* b,const std::uint8_t* e)
+    {
+        Status status;
+        b = read(b,e,status);
+        if(b == 0)
+            throw Except(status);
+        return b;
+    }
+
+    const std::uint8_t* MessageView::parse(const std::uint8_t* b,const std::uint8_t* e,Status& status)
+    {
+        Middle tlv;
+        data = b;
+        end = e;
+        // Never 0 once set, as the PDU follows the message header.
+        pdu = 0;
+        varbinds.clear();
+        if((b = readHeader(tlv,b,e,Complex::sequence,status)) == 0)
+            return 0;
+        e = b + tlv.getLength();
+        version = b - data;
+        if((b = readHeader(tlv,b,e,Primitive::tinteger,status)) == 0)
+            return 0;
+        community = (b += tlv.getLength()) - data;
+        if((b = readHeader(tlv,b,e,Primitive::tocted_string,status)) == 0)
+            return 0;
+        pdu = (b += tlv.getLength()) - data;
+        if((b = tlv.decode(b,e,status)) == 0)
+            return 0;
+        if(tlv.getType() != Complex::get_request && tlv.getType() != Complex::get_next_request && tlv.getType() != Complex::get_response && tlv.getType() != Complex::set_request && tlv.getType() != Complex::get_bulk_request &&
+            tlv.getType() != Complex::inform_request && tlv.getType() != Complex::snmpv2_trap)
+            return failHeader(tlv,data + pdu,Except::bad_type,status);
+        request_id = b - data;
+        if((b = readHeader(tlv,b,e,Primitive::tinteger,status)) == 0)
+            return 0;
+        error = (b += tlv.getLength()) - data;
+        if((b = readHeader(tlv,b,e,Primitive::tinteger,status)) == 0)
+            return 0;
+        error_id = (b += tlv.getLength()) - data;
+        if((b = readHeader(tlv,b,e,Primitive::tinteger,status)) == 0)
+            return 0;
+        varbind_list = (b += tlv.getLength()) - data;
+        if((b = readHeader(tlv,b,e,Complex::sequence,status)) == 0)
+            return 0;
+        const std::uint8_t* vbs_end = b + tlv.getLength();
+        varbind_list_end = vbs_end - data;
+        while(b < vbs_end)
+        {
+            Entry entry;
+            entry.varbind = b - data;
+            if((b = readHeader(tlv,b,vbs_end,Complex::sequence,status)) == 0)
+                return 0;
+            const std::uint8_t* vb_end = b + tlv.getLength();
+            entry.oid = b - data;
+            if((b = readHeader(tlv,b,vb_end,Primitive::tobject_identifier,status)) == 0)
+                return 0;
+            entry.value = (b += tlv.getLength()) - data;
+            if((b = tlv.decode(b,vb_end,status)) == 0)
+                return 0;
+            if(b + tlv.getLength() != vb_end)
+                return failHeader(tlv,data + entry.value,Except::proto_error,status);
+            b = vb_end;
+            varbinds.push_back(entry);
+        }
+        return e;
+    }
+
+    Encoder::Encoder(std::pmr::memory_resource* mr,size_t n,size_t max) : resource(mr), max_size(std::max(n,max))
+    {
+        begin = static_cast<std::uint8_t*>(resource->allocate(n,1));
+        end = begin + n;
+        pos = end;
+    }
+
+    Encoder::~Encoder()
+    {
+        if(resource)
+            resource->deallocate(begin,end - begin,1);
     }
-}
 
+    void Encoder::reserve(size_t n)
+    {
+        if(size_t(pos - begin) < n)
+            grow(n);
+    }
+
+    // The bytes written so far sit at the end of the buffer and marks count
+    // from there, so they move to the end of the new one.
+    void Encoder::grow(size_t n)
+    {
+        size_t used = end - pos;
+        if(resource == 0 || n > max_size - used)
+            throw Except(typeid(*this).name(),Except::too_big);
+        size_t capacity = std::min(std::max<size_t>((end - begin) * 2,used + n),max_size);
+        std::uint8_t* b = static_cast<std::uint8_t*>(resource->allocate(capacity,1));
+        std::memcpy(b + capacity - used,pos,used);
+        resource->deallocate(begin,end - begin,1);
+        begin = b;
+        end = b + capacity;
+        pos = end - used;
+    }
+
+    void Encoder::writeHeader(std::uint8_t type,std::uint32_t len)
+    {
+        if(len <= 127)
+        {
+            reserve(2);
+            *--pos = len;
+        }
+        else
+        {
+            size_t n = unsignedLength(len);
+            reserve(2 + n);
+            for(size_t i = 0;i < n;i++,len >>= 8)
+                *--pos = len & 0xff;
+            *--pos = 0x80 | n;
+        }
+        *--pos = type;
+    }
+
+    void Encoder::writeUnsigned(std::uint8_t type,std::uint32_t v,size_t len)
+    {
+        reserve(len);
+        for(size_t i = 0;i < len;i++)
+        {
+            *--pos = (i < sizeof(v)) ? std::uint8_t(v) : 0;
+            v = (i < sizeof(v) - 1) ? v >> 8 : 0;
+        }
+        writeHeader(type,len);
+    }
+
+    void Encoder::writeSubidentifier(std::uint32_t v)
+    {
+        size_t n = subidentifierLength(v);
+        reserve(n);
+        *--pos = v & 0x7f;
+        for(size_t i = 1;i < n;i++)
+        {
+            v >>= 7;
+            *--pos = 0x80 | (v & 0x7f);
+        }
+    }
+
+    void Encoder::close(std::uint8_t type,size_t m)
+    {
+        writeHeader(type,mark() - m);
+    }
+
+    void Encoder::writeInteger(int32_t v)
+    {
+        writeUnsigned(Primitive::tinteger,v,unsignedLength(v));
+    }
+
+    void Encoder::writeCounter(std::uint32_t v)
+    {
+        writeUnsigned(Primitive::tcounter,v,unsignedLength(v));
+    }
+
+    void Encoder::writeGauge(std::uint32_t v)
+    {
+        writeUnsigned(Primitive::tgauge,v,unsignedLength(v));
+    }
+
+    void Encoder::writeTimeTicks(std::uint32_t v)
+    {
+        writeUnsigned(Primitive::ttime_ticks,v,unsignedLength(v));
+    }
+
+    void Encoder::writeOctetString(const char* str,size_t n)
+    {
+        reserve(n);
+        pos -= n;
+        std::copy(str,str + n,pos);
+        writeHeader(Primitive::tocted_string,n);
+    }
+
+    void Encoder::writeNull()
+    {
+        writeHeader(Primitive::tnull,0);
+    }
+
+    void Encoder::writeIpAddress(std::uint32_t v)
+    {
+        reserve(4);
+        for(size_t i = 0;i < 4;i++,v >>= 8)
+            *--pos = v & 0xff;
+        writeHeader(Primitive::tip_address,4);
+    }
+
+    void Encoder::writeEncoded(const std::uint8_t* data,size_t n)
+    {
+        reserve(n);
+        pos -= n;
+        std::memcpy(pos,data,n);
+    }
+
+    void Encoder::writeOid(const std::uint32_t *oid, size_t n)
+    {
+        size_t m = mark();
+        for(size_t i = n;i > 2;i--)
+            writeSubidentifier(oid[i - 1]);
+        writeSubidentifier(0x2b);
+        close(Primitive::tobject_identifier,m);
+    }
+
+    void Encoder::write(const Integer& v)
+    {
+        writeUnsigned(v.getType(),v.getValue(),v.getLength());
+    }
+
+    void Encoder::write(const Counter& v)
+    {
+        writeUnsigned(v.getType(),v.getValue(),v.getLength());
+    }
+
+    void Encoder::write(const Gauge& v)
+    {
+        writeUnsigned(v.getType(),v.getValue(),v.getLength());
+    }
+
+    void Encoder::write(const TimeTicks& v)
+    {
+        writeUnsigned(v.getType(),v.getValue(),v.getLength());
+    }
+
+    void Encoder::write(const OctetString& v)
+    {
+        size_t m = mark();
+        const char* str = v;
+        reserve(v.getLength());
+        pos -= v.getLength();
+        std::copy(str,str + v.getLength(),pos);
+        close(v.getType(),m);
+    }
+
+    void Encoder::write(const Null& v)
+    {
+        writeHeader(v.getType(),0);
+    }
+
+    void Encoder::write(const IpAddress& v)
+    {
+        writeIpAddress(v.getValue());
+    }
+
+    void Encoder::write(const Unknow& v)
+    {
+        reserve(v.getLength());
+        pos -= v.getLength();
+        std::fill(pos,pos + v.getLength(),0);
+        writeHeader(v.getType(),v.getLength());
+    }
+
+    void Encoder::write(const Oid& v)
+    {
+        size_t m = mark();
+        for(size_t i = v.getValueSize();i > 0;i--)
+            writeSubidentifier(v[i - 1]);
+        close(v.getType(),m);
+    }
+
+    void Encoder::write(const Varbind& v)
+    {
+        size_t m = mark();
+        writeValue(v);
+        write(v.getOid());
+        close(v.getType(),m);
+    }
+
+    void Encoder::writeValue(const Varbind& v)
+    {
+        if(v.getEncodedValue())
+        {
+            writeEncoded(v.getEncodedValue()->data(),v.getEncodedValue()->size());
+            return;
+        }
+        switch(v.getValueType())
+        {
+        case Primitive::tinteger:
+            write(v.getInteger());
+            break;
+        case Primitive::tcounter:
+            write(v.getCounter());
+            break;
+        case Primitive::tgauge:
+            write(v.getGauge());
+            break;
+        case Primitive::ttime_ticks:
+            write(v.getTimeTicks());
+            break;
+        case Primitive::tocted_string:
+            write(v.getOctetString());
+            break;
+        case Primitive::tobject_identifier:
+            write(v.getOidValue());
+            break;
+        case Primitive::tip_address:
+            write(v.getIpAddress());
+            break;
+        case Primitive::tnull:
+        case Primitive::tno_such_object:
+        case Primitive::tno_such_instance:
+        case Primitive::tend_of_mib_view:
+            write(v.getNull());
+            break;
+        default:
+            write(v.getUnknow());
+            break;
+        }
+    }
+
+    void Encoder::write(const Varbinds& v)
+    {
+        size_t m = mark();
+        for(size_t i = v.getValue().size();i > 0;i--)
+        {
+            write(v.getValue()[i - 1]);
+        }
+        close(v.getType(),m);
+    }
+
+    void Encoder::write(const PDU& v)
+    {
+        size_t m = mark();
+        write(v.getVarbinds());
+        write(v.getErrorID());
+        write(v.getError());
+        write(v.getRequestID());
+        close(v.getType(),m);
+    }
+
+    void Encoder::write(const TrapPDU& v)
+    {
+        size_t m = mark();
+        write(v.getVarbinds());
+        write(v.getTimeStamp());
+        write(v.getSpecificTrap());
+        write(v.getGenericTrap());
+        write(v.getAgentAddress());
+        write(v.getEnterprise());
+        close(v.getType(),m);
+    }
+
+    void Encoder::write(const Message& v)
+    {
+        size_t m = mark();
+        if(v.getPDUType() == Complex::trap)
+            write(v.getTrap());
+        else
+            write(v.getPDU());
+        write(v.getCommunity());
+        write(v.getVersion());
+        close(v.getType(),m);
+    }
+
+    StreamDecoder::StreamDecoder(const Handler& h,size_t max,std::pmr::memory_resource* resource) :
+        handler(h), max_size(max), pending(resource), arena(resource)
+    {
+        reset();
+    }
+
+    void StreamDecoder::reset()
+    {
+        state = tag;
+        offset = 0;
+        depth = 0;
+        pending.clear();
+    }
+
+    void StreamDecoder::push(const std::uint8_t* data,size_t n)
+    {
+        const std::uint8_t* e = data + n;
+        while(data < e)
+        {
+            bool complete = false;
+            size_t used = scan(data,e,complete);
+            if(!complete)
+            {
+                // Sized once from the message header, so appending never
+                // moves what is already there.
+                if(depth > 0 && pending.capacity() < ends[0])
+                    pending.reserve(ends[0]);
+                pending.insert(pending.end(),data,data + used);
+            }
+            else if(pending.empty())
+                emit(data,data + used);
+            else
+            {
+                pending.insert(pending.end(),data,data + used);
+                emit(pending.data(),pending.data() + pending.size());
+                pending.clear();
+            }
+            data += used;
+        }
+    }
+
+    // Follows the framing from b on until the current message ends or the
+    // input runs out, and returns the number of bytes consumed.
+    size_t StreamDecoder::scan(const std::uint8_t* b,const std::uint8_t* e,bool& complete)
+    {
+        const std::uint8_t* p = b;
+        while(p < e)
+        {
+            // With the rest of the message at hand there is nothing to gain
+            // from following it; decoding checks the inner framing anyway.
+            if(state == tag && depth > 0 && size_t(e - p) >= ends[0] - offset)
+            {
+                p += ends[0] - offset;
+                depth = 0;
+                offset = 0;
+                complete = true;
+                return p - b;
+            }
+            switch(state)
+            {
+            case tag:
+                type = *p++;
+                offset++;
+                // Single byte tags only, and a message is a SEQUENCE.
+                if((type & 0x1f) == 0x1f || (depth == 0 && type != Complex::sequence))
+                    throw Except(typeid(*this).name(),Except::proto_error);
+                state = length;
+                break;
+            case length:
+                len = *p++;
+                offset++;
+                if(len & 0x80)
+                {
+                    // Indefinite lengths are not allowed in SNMP.
+                    length_left = len & 0x7f;
+                    if(length_left == 0 || length_left > sizeof(len))
+                        throw Except(typeid(*this).name(),Except::proto_error);
+                    len = 0;
+                    state = length_bytes;
+                }
+                else
+                    header(type,len);
+                break;
+            case length_bytes:
+                len = (len << 8) | *p++;
+                offset++;
+                if(--length_left == 0)
+                    header(type,len);
+                break;
+            case contents:
+            {
+                size_t n = std::min<size_t>(e - p,skip_end - offset);
+                p += n;
+                offset += n;
+                if(offset == skip_end)
+                    state = tag;
+                break;
+            }
+            }
+            // Closes every element that ends here; the message is complete
+            // when the outermost one does.
+            if(state == tag)
+            {
+                while(depth > 0 && ends[depth - 1] == offset)
+                    depth--;
+                if(depth == 0)
+                {
+                    offset = 0;
+                    complete = true;
+                    return p - b;
+                }
+            }
+        }
+        return p - b;
+    }
+
+    void StreamDecoder::header(std::uint8_t t,std::uint32_t n)
+    {
+        if(depth == 0)
+        {
+            if(offset + std::uint64_t(n) > max_size)
+                throw Except(typeid(*this).name(),Except::too_big);
+        }
+        else if(offset + std::uint64_t(n) > ends[depth - 1])
+            throw Except(typeid(*this).name(),Except::proto_error);
+        if(t & 0x20)
+        {
+            if(depth == max_depth)
+                throw Except(typeid(*this).name(),Except::proto_error);
+            ends[depth++] = offset + n;
+            state = tag;
+        }
+        else
+        {
+            skip_end = offset + n;
+            state = n > 0 ? contents : tag;
+        }
+    }
+
+    void StreamDecoder::emit(const std::uint8_t* b,const std::uint8_t* e)
+    {
+        // Releases the arena on the way out, thrown or not; declared first so
+        // the message is destroyed before its memory goes.
+        struct Release
+        {
+            std::pmr::monotonic_buffer_resource& arena;
+            ~Release() { arena.release(); }
+        } release = { arena };
+        Message m(&arena);
+        m.read(b,e);
+        handler(m);
+    }
+}
@@ -16,33 +16,85 @@
  */
 #pragma once
 #include <vector>
-#include <list>
+#include <array>
+#include <algorithm>
 #include <string>
+#include <string_view>
 #include <cstdint>
+#include <functional>
+#include <variant>
+#include <utility>
+#include <memory>
+#include <memory_resource>
+#include <typeinfo>
 
 namespace snmp
 {
+    // Non-owning view over a contiguous array.
+    template <typename T> class Span
+    {
+    public:
+        typedef const T* const_iterator;
+        Span() : first(0), n(0) {}
+        Span(const T* p,size_t size) : first(p), n(size) {}
+        const T* begin() const { return first; }
+        const T* end() const { return first + n; }
+        const T* data() const { return first; }
+        size_t size() const { return n; }
+        bool empty() const { return n == 0; }
+        const T& operator[](size_t i) const { return first[i]; }
+    private:
+        const T* first;
+        size_t n;
+    };
+
     class Abstract;
+    struct Status;
     class Except : public std::exception
     {
     public:
-        enum Code { bad_type, proto_error, bad_oid };
+        enum Code { bad_type, proto_error, bad_oid, too_big, no_memory };
         Except(const Abstract* _id,Code code) throw();
+        Except(const char* _id,Code code) throw();
+        Except(const Status& status) throw();
         ~Except() throw() {}
         const char* what() const throw();
+        Code getCode() const { return code; }
     private:
         std::string str;
-        static const std::string message[3];
+        Code code;
+        static const std::string message[5];
     };
 
 
+    // Outcome of a non-throwing read(). On failure element is the type of the
+    // element that could not be decoded and offset is where, from the start of
+    // the input, the problem was found (position points at the same byte).
+    struct Status
+    {
+        Status() : element(0), code(Except::proto_error), offset(0), position(0) {}
+        bool ok() const { return element == 0; }
+        const std::type_info* element;
+        Except::Code code;
+        size_t offset;
+        const std::uint8_t* position;
+    };
+
     class Abstract
     {
     public:
         Abstract() : _size(0) {}
         size_t getSize() const { return _size; }
+        // Never throws: malformed input is reported in status, and allocation
+        // failures (or any other exception from decoding) as no_memory.
+        const std::uint8_t* read(const std::uint8_t* b,const std::uint8_t* e,Status& status) noexcept;
+        const std::uint8_t* read(const std::uint8_t* b,const std::uint8_t* e);
+        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        // Decodes one element. Returns the position after it, or 0 with status
+        // filled in; callers normally go through read().
+        virtual const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status) = 0;
     protected:
-        virtual std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e) = 0;
+        const std::uint8_t* fail(Status& status,const std::uint8_t* at,Except::Code code) const;
         virtual void write(std::vector<std::uint8_t>& d) const = 0;
         size_t _size;
     };
@@ -53,7 +105,7 @@ namespace snmp
         MultibyteLen() : value(0) {}
         MultibyteLen(std::uint32_t val);
         std::uint32_t getValue() const { return value; }
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
         operator std::uint32_t() const { return value; }
     protected:
@@ -66,7 +118,7 @@ namespace snmp
         MultibyteValue() : value(0) {}
         MultibyteValue(std::uint64_t val);
         std::uint64_t getValue() const { return value; }
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
     protected:
         std::uint64_t value;
@@ -77,7 +129,7 @@ namespace snmp
     public:
         std::uint8_t getType() const { return type; }
         const MultibyteLen& getLength() const { return length; }
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
     protected:
         std::uint8_t type;
@@ -87,9 +139,10 @@ namespace snmp
     class Primitive : public Middle
     {
     public:
-        enum Type { tinteger = 0x02, tocted_string = 0x04, tnull = 0x05, tobject_identifier = 0x06, tcounter=0x41, tgauge=0x42, ttime_ticks = 0x43 };
+        enum Type { tinteger = 0x02, tocted_string = 0x04, tnull = 0x05, tobject_identifier = 0x06, tip_address = 0x40, tcounter=0x41, tgauge=0x42, ttime_ticks = 0x43,
+            tno_such_object = 0x80, tno_such_instance = 0x81, tend_of_mib_view = 0x82 };
         Primitive() { type = 0; length = 0; }
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
     protected:
     };
@@ -97,8 +150,10 @@ namespace snmp
     class Null : public Primitive
     {
     public:
-        Null() { type = tnull; length = 0; _size = 2; }
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        // Also carries the empty SNMPv2 exception values (noSuchObject,
+        // noSuchInstance, endOfMibView) when given their type.
+        explicit Null(Type t = tnull) { type = t; length = 0; _size = 2; }
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
     protected:
     };
@@ -109,7 +164,7 @@ namespace snmp
         Integer() {}
         Integer(int32_t val);
         int32_t getValue() const { return value; }
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
         operator int32_t() const { return value; }
     protected:
@@ -122,7 +177,7 @@ namespace snmp
         Counter() {}
         Counter(std::uint32_t val);
         std::uint32_t getValue() const { return value; }
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
         operator std::uint32_t() const { return value; }
     protected:
@@ -135,7 +190,7 @@ namespace snmp
         Gauge() {}
         Gauge(std::uint32_t val);
         std::uint32_t getValue() const { return value; }
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
         operator std::uint32_t() const { return value; }
     protected:
@@ -147,7 +202,7 @@ namespace snmp
     public:
         TimeTicks() {}
         TimeTicks(std::uint32_t v);
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
         std::uint32_t getValue() const { return value; }
         int16_t days() const;
@@ -164,31 +219,49 @@ namespace snmp
     {
     public:
         OctetString() {}
+        explicit OctetString(std::pmr::memory_resource* resource) : value(resource) {}
         OctetString(const char* val);
         OctetString(const std::string& val);
         std::string getValue() const;
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
         operator const char*() const { return value.c_str(); }
     protected:
-        std::string value;
+        std::pmr::string value;
     private:
         void setValue(const std::string& str);
     };
 
+    // IPv4 address, four octets in network order. The value is kept in host
+    // order, so 10.0.0.1 is 0x0a000001.
+    class IpAddress : public Primitive
+    {
+    public:
+        IpAddress() { type = tip_address; length = 4; _size = 6; value = 0; }
+        IpAddress(std::uint32_t v);
+        std::uint32_t getValue() const { return value; }
+        // Dotted quad.
+        std::string asString() const;
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
+        void write(std::vector<std::uint8_t>& d) const;
+    protected:
+        std::uint32_t value;
+    };
+
     class Unknow : public Primitive
     {
     public:
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
     };
 
     class Complex : public Middle
     {
     public:
-        enum Type { sequence = 0x30, get_request = 0xa0, get_next_request = 0xa1, get_response = 0xa2, set_request = 0xa3, trap = 0xa4 };
+        enum Type { sequence = 0x30, get_request = 0xa0, get_next_request = 0xa1, get_response = 0xa2, set_request = 0xa3, trap = 0xa4, get_bulk_request = 0xa5,
+            inform_request = 0xa6, snmpv2_trap = 0xa7 };
         Complex() { type = 0; length = 0; }
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
     protected:
     };
@@ -196,86 +269,234 @@ namespace snmp
     class Oid : public Primitive
     {
     public:
-        Oid() {}
+        Oid() : value(buffer), count(0), capacity(inline_size), resource(std::pmr::get_default_resource()) {}
+        explicit Oid(std::pmr::memory_resource* mr) : value(buffer), count(0), capacity(inline_size), resource(mr) {}
         Oid(const std::uint32_t *oid, size_t n);
-        Oid(const std::string& oid);
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        // Dotted notation, which must start with 1.3; throws Except::bad_oid.
+        Oid(std::string_view oid);
+        Oid(const Oid& oid);
+        Oid(Oid&& oid);
+        ~Oid();
+        Oid& operator=(const Oid& oid);
+        Oid& operator=(Oid&& oid);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
         std::uint32_t getBack(size_t n = 0) const;
         const std::uint32_t operator[](size_t n) const;
+        // Raw subidentifiers, so 1.3 shows as 43.
         std::string asString() const;
-        size_t getValueSize() const { return value.size(); }
+        // Writes the dotted notation accepted by Oid(std::string_view) into
+        // [first,last) and returns the end of it, or 0 if it does not fit.
+        // Allocates nothing; maxStringSize(getValueSize()) characters are
+        // always enough.
+        char* format(char* first,char* last) const;
+        static constexpr size_t maxStringSize(size_t subidentifiers) { return (subidentifiers + 1) * (max_arc_chars + 1); }
+        size_t getValueSize() const { return count; }
+        const std::uint32_t* getValue() const { return value; }
+        std::pmr::memory_resource* getResource() const { return resource; }
+        size_t hash() const;
         Oid operator+(std::uint32_t v) const;
     private:
-        std::vector<MultibyteValue> value;
+        // Subidentifiers are kept as plain integers, inline for typical OIDs
+        // and allocated from resource only past inline_size.
+        enum { inline_size = 16 };
+        static constexpr size_t max_arc_chars = 10;
+        void reserve(size_t n);
+        void release();
+        void append(std::uint32_t v);
+        std::uint32_t* value;
+        std::uint32_t count;
+        std::uint32_t capacity;
+        std::pmr::memory_resource* resource;
+        std::uint32_t buffer[inline_size];
     };
 
     bool operator==(const Oid& oid1,const Oid& oid2);
     bool operator!=(const Oid& oid1,const Oid& oid2);
     bool operator<(const Oid& oid1,const Oid& oid2);
 
+    namespace detail
+    {
+        constexpr size_t subidentifierBytes(std::uint32_t v)
+        {
+            size_t n = 1;
+            for(;v > 0x7f;v >>= 7)
+                n++;
+            return n;
+        }
+
+        constexpr size_t lengthBytes(size_t len)
+        {
+            size_t n = 1;
+            if(len > 127)
+            {
+                for(;len != 0;len >>= 8)
+                    n++;
+            }
+            return n;
+        }
+
+        template <std::uint32_t A1,std::uint32_t A2,std::uint32_t... Rest> constexpr std::array<std::uint32_t,sizeof...(Rest) + 1> oidSubidentifiers()
+        {
+            return {{ 40 * A1 + A2,Rest... }};
+        }
+
+        template <std::uint32_t... Arcs> constexpr size_t oidContentLength()
+        {
+            size_t n = 0;
+            for(std::uint32_t v : oidSubidentifiers<Arcs...>())
+                n += subidentifierBytes(v);
+            return n;
+        }
+
+        template <std::uint32_t... Arcs> constexpr size_t oidEncodedLength()
+        {
+            return 1 + lengthBytes(oidContentLength<Arcs...>()) + oidContentLength<Arcs...>();
+        }
+
+        template <std::uint32_t... Arcs> constexpr std::array<std::uint8_t,oidEncodedLength<Arcs...>()> oidEncoding()
+        {
+            std::array<std::uint8_t,oidEncodedLength<Arcs...>()> b{};
+            size_t len = oidContentLength<Arcs...>();
+            size_t p = 0;
+            b[p++] = Primitive::tobject_identifier;
+            if(len <= 127)
+                b[p++] = len;
+            else
+            {
+                size_t n = lengthBytes(len) - 1;
+                b[p++] = 0x80 | n;
+                for(size_t i = n;i > 0;i--)
+                    b[p++] = (len >> (8 * (i - 1))) & 0xff;
+            }
+            for(std::uint32_t v : oidSubidentifiers<Arcs...>())
+            {
+                for(size_t i = subidentifierBytes(v);i > 0;i--)
+                    b[p++] = ((v >> (7 * (i - 1))) & 0x7f) | (i > 1 ? 0x80 : 0);
+            }
+            return b;
+        }
+    }
+
+    // OID known at compile time, e.g. oid<1,3,6,1,2,1,1,3,0>. Its
+    // subidentifiers and complete BER encoding are constants, so it can be
+    // compared with decoded OIDs or raw packet bytes and written by Encoder
+    // without encoding anything at run time.
+    template <std::uint32_t... Arcs> struct oid
+    {
+        static_assert(sizeof...(Arcs) >= 2,"an OID has at least two arcs");
+        static constexpr std::uint32_t arcs[] = { Arcs... };
+        static_assert(arcs[0] == 1 && arcs[1] == 3,"OIDs start with 1.3");
+        static constexpr std::array<std::uint32_t,sizeof...(Arcs) - 1> subidentifiers = detail::oidSubidentifiers<Arcs...>();
+        static constexpr std::array<std::uint8_t,detail::oidEncodedLength<Arcs...>()> encoded = detail::oidEncoding<Arcs...>();
+        static Oid get() { return Oid(arcs,sizeof...(Arcs)); }
+        static bool equals(const Oid& o)
+        {
+            return o.getValueSize() == subidentifiers.size() && std::equal(subidentifiers.begin(),subidentifiers.end(),o.getValue());
+        }
+        // Whether [b,e) starts with this OID's encoding.
+        static bool matches(const std::uint8_t* b,const std::uint8_t* e)
+        {
+            return size_t(e - b) >= encoded.size() && std::equal(encoded.begin(),encoded.end(),b);
+        }
+        operator Oid() const { return get(); }
+    };
+
+    template <std::uint32_t... Arcs> bool operator==(const Oid& o,oid<Arcs...>) { return oid<Arcs...>::equals(o); }
+    template <std::uint32_t... Arcs> bool operator==(oid<Arcs...>,const Oid& o) { return oid<Arcs...>::equals(o); }
+    template <std::uint32_t... Arcs> bool operator!=(const Oid& o,oid<Arcs...>) { return !oid<Arcs...>::equals(o); }
+    template <std::uint32_t... Arcs> bool operator!=(oid<Arcs...>,const Oid& o) { return !oid<Arcs...>::equals(o); }
+
     class Varbind : public Complex
     {
     public:
-        Varbind() : value(&null) {}
-        Varbind(const Varbind& vb);
+        Varbind() {}
+        explicit Varbind(std::pmr::memory_resource* resource) : oid(resource) {}
         Varbind(const Oid& _oid,const Integer& _int);
         Varbind(const Oid& _oid,const Counter& ct);
         Varbind(const Oid& _oid,const Gauge& ga);
         Varbind(const Oid& _oid,const TimeTicks& tt);
         Varbind(const Oid& _oid,const OctetString& os);
         Varbind(const Oid& _oid,const Oid& _oidv);
+        Varbind(const Oid& _oid,const IpAddress& ip);
         Varbind(const Oid& _oid);
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        Varbind(const Oid& _oid,const Null& n);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
         const Oid& getOid() const { return oid; }
         std::uint8_t getValueType() const;
         const Primitive& getValue() const;
-        const Integer& getInteger() const { return integer; }
-        const Counter& getCounter() const { return counter; }
-        const Gauge& getGauge() const { return gauge; }
-        const TimeTicks& getTimeTicks() const { return time_ticks; }
-        const OctetString& getOctetString() const { return octet_string; }
-        const Oid& getOidValue() const { return oidv; }
-        const Unknow& getUnknow() const { return unknow; }
-        Varbind& operator=(const Varbind& vb);
+        const Integer& getInteger() const { return get<Integer>(); }
+        const Counter& getCounter() const { return get<Counter>(); }
+        const Gauge& getGauge() const { return get<Gauge>(); }
+        const TimeTicks& getTimeTicks() const { return get<TimeTicks>(); }
+        const OctetString& getOctetString() const { return get<OctetString>(); }
+        const Oid& getOidValue() const { return get<Oid>(); }
+        const IpAddress& getIpAddress() const { return get<IpAddress>(); }
+        const Null& getNull() const { return get<Null>(); }
+        const Unknow& getUnknow() const { return get<Unknow>(); }
+        // Encoding of the value element, shared between copies. When set,
+        // Encoder copies it instead of encoding the value again; it must
+        // match the value.
+        typedef std::shared_ptr<const std::vector<std::uint8_t>> Encoded;
+        void setEncodedValue(const Encoded& e) { encoded = e; }
+        const Encoded& getEncodedValue() const { return encoded; }
     protected:
-        void copy(const Varbind& vb);
+        // Only the active value type is stored; asking for another one throws
+        // Except::bad_type. Decoded values allocate from the resource of oid.
+        typedef std::variant<Null,Integer,Counter,Gauge,TimeTicks,OctetString,Oid,IpAddress,Unknow> Value;
+        template <typename T> const T& get() const
+        {
+            const T* v = std::get_if<T>(&value);
+            if(v == 0)
+                throw Except(this,Except::bad_type);
+            return *v;
+        }
+        void setLength();
         Oid oid;
-        Integer integer;
-        Counter counter;
-        Gauge gauge;
-        TimeTicks time_ticks;
-        OctetString octet_string;
-        Oid oidv;
-        Null null;
-        Unknow unknow;
-        Primitive* value;
+        Value value;
+        Encoded encoded;
     };
 
     class Varbinds : public Complex
     {
     public:
         Varbinds();
+        explicit Varbinds(std::pmr::memory_resource* resource);
+        void reserve(size_t n) { value.reserve(n); }
         void addVarbind(const Varbind& vb);
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        void addVarbind(Varbind&& vb);
+        template <typename... Args> const Varbind& emplaceVarbind(Args&&... args)
+        {
+            value.emplace_back(std::forward<Args>(args)...);
+            added();
+            return value.back();
+        }
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
-        const std::list<Varbind>& getValue() const { return value; }
+        Span<Varbind> getValue() const { return Span<Varbind>(value.data(),value.size()); }
     protected:
-        std::list<Varbind> value;
+        void added();
+        std::pmr::vector<Varbind> value;
     };
 
     class PDU : public Complex
     {
     public:
-        enum Error { noError=0, tooLarge=1, noSuchName=2, noType=3, readOnly=4, generalError=5 };
+        enum Error { noError=0, tooLarge=1, noSuchName=2, noType=3, readOnly=4, generalError=5,
+            noAccess=6, wrongType=7, wrongLength=8, wrongEncoding=9, wrongValue=10, noCreation=11, inconsistentValue=12,
+            resourceUnavailable=13, commitFailed=14, undoFailed=15, authorizationError=16, notWritable=17, inconsistentName=18 };
         PDU() {}
+        explicit PDU(std::pmr::memory_resource* resource) : varbinds(resource) {}
         PDU(Complex::Type t,const Integer& req_id,const Integer& e,const Integer& e_id,const Varbinds& vs);
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
         const Integer& getRequestID() const { return request_id; }
         const Integer& getError() const { return error; }
         const Integer& getErrorID() const { return error_id; }
+        // GetBulkRequest carries these in place of the error fields.
+        const Integer& getNonRepeaters() const { return error; }
+        const Integer& getMaxRepetitions() const { return error_id; }
         const Varbinds& getVarbinds() const { return varbinds; }
     protected:
         Integer request_id;
@@ -284,24 +505,238 @@ namespace snmp
         Varbinds varbinds;
     };
 
+    // SNMPv1 Trap-PDU (RFC 1157). v2c notifications use the ordinary PDU
+    // layout with snmpv2_trap or inform_request as type.
+    class TrapPDU : public Complex
+    {
+    public:
+        enum Generic { coldStart=0, warmStart=1, linkDown=2, linkUp=3, authenticationFailure=4, egpNeighborLoss=5, enterpriseSpecific=6 };
+        TrapPDU() {}
+        explicit TrapPDU(std::pmr::memory_resource* resource) : enterprise(resource), varbinds(resource) {}
+        TrapPDU(const Oid& ent,const IpAddress& addr,const Integer& gen,const Integer& spec,const TimeTicks& ts,const Varbinds& vs);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
+        void write(std::vector<std::uint8_t>& d) const;
+        const Oid& getEnterprise() const { return enterprise; }
+        const IpAddress& getAgentAddress() const { return agent_addr; }
+        const Integer& getGenericTrap() const { return generic_trap; }
+        const Integer& getSpecificTrap() const { return specific_trap; }
+        const TimeTicks& getTimeStamp() const { return time_stamp; }
+        const Varbinds& getVarbinds() const { return varbinds; }
+    protected:
+        Oid enterprise;
+        IpAddress agent_addr;
+        Integer generic_trap;
+        Integer specific_trap;
+        TimeTicks time_stamp;
+        Varbinds varbinds;
+    };
+
     enum Type { v1 = 0, v2c = 1, v3 = 2 };
 
     class Message : public Complex
     {
     public:
-        Message() {}
+        Message() : pdu_type(0) {}
+        // Everything decoded by read() is allocated from resource, so a
+        // monotonic arena can be dropped in one step once the message is done.
+        explicit Message(std::pmr::memory_resource* resource) : community(resource), pdu_type(0), pdu(resource), trap_pdu(resource) {}
         Message(const Integer& ver,const OctetString& comm);
         void set(const Integer& ver,const OctetString& comm);
         void setPDU(const PDU& _pdu);
-        std::vector<std::uint8_t>::const_iterator read(std::vector<std::uint8_t>::const_iterator b,const std::vector<std::uint8_t>::const_iterator e);
+        void setTrap(const TrapPDU& _trap);
+        const std::uint8_t* decode(const std::uint8_t* b,const std::uint8_t* e,Status& status);
         void write(std::vector<std::uint8_t>& d) const;
         const Integer& getVersion() const { return version; }
         const OctetString& getCommunity() const { return community; }
+        // A message carries either a PDU or, for a v1 trap, a TrapPDU;
+        // the type tells which one is set.
+        std::uint8_t getPDUType() const { return pdu_type; }
         const PDU& getPDU() const { return pdu; }
+        const TrapPDU& getTrap() const { return trap_pdu; }
     protected:
         Integer version;
         OctetString community;
+        std::uint8_t pdu_type;
         PDU pdu;
+        TrapPDU trap_pdu;
+    };
+
+    // Read-only view over an encoded message. The framing is checked once and
+    // only byte offsets are kept; fields are decoded when asked for. The view
+    // does not own the bytes, they must outlive it.
+    class MessageView
+    {
+    public:
+        MessageView() : data(0), end(0), pdu(0), varbind_list(0), varbind_list_end(0) {}
+        explicit MessageView(std::pmr::memory_resource* resource) : data(0), end(0), pdu(0), varbind_list(0), varbind_list_end(0), varbinds(resource) {}
+        MessageView(const std::uint8_t* b,const std::uint8_t* e);
+        // Never throws, as Abstract::read.
+        const std::uint8_t* read(const std::uint8_t* b,const std::uint8_t* e,Status& status) noexcept;
+        const std::uint8_t* read(const std::uint8_t* b,const std::uint8_t* e);
+        Integer getVersion() const { return decode<Integer>(version); }
+        OctetString getCommunity() const { return decode<OctetString>(community); }
+        // 0 if no message was read or its read failed before the PDU.
+        std::uint8_t getPDUType() const { return pdu != 0 ? data[pdu] : 0; }
+        Integer getRequestID() const { return decode<Integer>(request_id); }
+        Integer getError() const { return decode<Integer>(error); }
+        Integer getErrorID() const { return decode<Integer>(error_id); }
+        Integer getNonRepeaters() const { return decode<Integer>(error); }
+        Integer getMaxRepetitions() const { return decode<Integer>(error_id); }
+        size_t getVarbindCount() const { return varbinds.size(); }
+        Varbind getVarbind(size_t n) const { return decode<Varbind>(varbinds.at(n).varbind); }
+        Oid getOid(size_t n) const { return decode<Oid>(varbinds.at(n).oid); }
+        std::uint8_t getValueType(size_t n) const { return data[varbinds.at(n).value]; }
+        Integer getInteger(size_t n) const { return decode<Integer>(varbinds.at(n).value); }
+        Counter getCounter(size_t n) const { return decode<Counter>(varbinds.at(n).value); }
+        Gauge getGauge(size_t n) const { return decode<Gauge>(varbinds.at(n).value); }
+        TimeTicks getTimeTicks(size_t n) const { return decode<TimeTicks>(varbinds.at(n).value); }
+        OctetString getOctetString(size_t n) const { return decode<OctetString>(varbinds.at(n).value); }
+        Oid getOidValue(size_t n) const { return decode<Oid>(varbinds.at(n).value); }
+        // Encoded varbind list, header included.
+        const std::uint8_t* getVarbindsBegin() const { return data + varbind_list; }
+        const std::uint8_t* getVarbindsEnd() const { return data + varbind_list_end; }
+    private:
+        struct Entry
+        {
+            std::uint32_t varbind;
+            std::uint32_t oid;
+            std::uint32_t value;
+        };
+        const std::uint8_t* parse(const std::uint8_t* b,const std::uint8_t* e,Status& status);
+        template <typename T> T decode(std::uint32_t offset) const
+        {
+            T t;
+            t.read(data + offset,end);
+            return t;
+        }
+        const std::uint8_t* data;
+        const std::uint8_t* end;
+        std::uint32_t version;
+        std::uint32_t community;
+        std::uint32_t pdu;
+        std::uint32_t request_id;
+        std::uint32_t error;
+        std::uint32_t error_id;
+        std::uint32_t varbind_list;
+        std::uint32_t varbind_list_end;
+        std::pmr::vector<Entry> varbinds;
+    };
+
+    // Single pass BER encoder. The message is written back to front into a
+    // caller supplied buffer: the contents of a constructed element go out
+    // before its header, so every length is known by the time it is written.
+    // Build order is therefore reversed, e.g. for a varbind:
+    //     size_t m = enc.mark(); enc.writeNull(); enc.writeOid(oid); enc.close(Complex::sequence,m);
+    // Writing past the buffer throws Except::too_big, unless the encoder owns
+    // it and may grow it further.
+    class Encoder
+    {
+    public:
+        Encoder(std::uint8_t* buffer,size_t n) : begin(buffer), end(buffer + n), pos(buffer + n), resource(0), max_size(n) {}
+        // Allocates n bytes from mr, and grows them as needed up to max_size
+        // bytes, by default not at all. Marks stay valid across growth.
+        Encoder(std::pmr::memory_resource* mr,size_t n,size_t max_size = 0);
+        Encoder(const Encoder&) = delete;
+        Encoder& operator=(const Encoder&) = delete;
+        ~Encoder();
+        const std::uint8_t* data() const { return pos; }
+        size_t size() const { return end - pos; }
+        size_t mark() const { return end - pos; }
+        void reset() { pos = end; }
+        void close(std::uint8_t type,size_t mark);
+        void writeInteger(int32_t v);
+        void writeCounter(std::uint32_t v);
+        void writeGauge(std::uint32_t v);
+        void writeTimeTicks(std::uint32_t v);
+        void writeOctetString(const char* str,size_t n);
+        void writeOctetString(const std::string& str) { writeOctetString(str.data(),str.size()); }
+        void writeNull();
+        void writeIpAddress(std::uint32_t v);
+        void writeOid(const std::uint32_t *oid, size_t n);
+        void write(const Integer& v);
+        void write(const Counter& v);
+        void write(const Gauge& v);
+        void write(const TimeTicks& v);
+        void write(const OctetString& v);
+        void write(const Null& v);
+        void write(const IpAddress& v);
+        void write(const Unknow& v);
+        void write(const Oid& v);
+        template <std::uint32_t... Arcs> void write(oid<Arcs...>) { writeEncoded(oid<Arcs...>::encoded.data(),oid<Arcs...>::encoded.size()); }
+        // Copies an element that is already encoded.
+        void writeEncoded(const std::uint8_t* data,size_t n);
+        void write(const Varbind& v);
+        // Just the value element of a varbind.
+        void writeValue(const Varbind& v);
+        void write(const Varbinds& v);
+        void write(const PDU& v);
+        void write(const TrapPDU& v);
+        void write(const Message& v);
+    private:
+        void reserve(size_t n);
+        void grow(size_t n);
+        void writeHeader(std::uint8_t type,std::uint32_t len);
+        void writeUnsigned(std::uint8_t type,std::uint32_t v,size_t len);
+        void writeSubidentifier(std::uint32_t v);
+        std::uint8_t* begin;
+        std::uint8_t* end;
+        std::uint8_t* pos;
+        std::pmr::memory_resource* resource;
+        size_t max_size;
+    };
+
+    // Push decoder for a byte stream of messages, as carried over TCP
+    // (RFC 3430). Chunks of any size are fed to push(); the TLV headers are
+    // followed as they arrive, keeping the nesting across chunks, and every
+    // message completed is decoded and passed to the handler. A message that
+    // lies whole within a chunk is decoded in place; only one split between
+    // chunks is copied, once, into a buffer sized from its header.
+    //
+    // Broken framing, a message over the maximum size or one that does not
+    // decode throws Except from push(), and exceptions from the handler pass
+    // through. Either way the stream cannot be resynchronized; it should be
+    // closed, or the decoder reset() for a new one.
+    class StreamDecoder
+    {
+    public:
+        typedef std::function<void(const Message&)> Handler;
+        explicit StreamDecoder(const Handler& h,size_t max_size = default_max_size,std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+        StreamDecoder(const StreamDecoder&) = delete;
+        StreamDecoder& operator=(const StreamDecoder&) = delete;
+        void push(const std::uint8_t* data,size_t n);
+        void reset();
+        // Bytes of an incomplete message held back so far.
+        size_t getBuffered() const { return pending.size(); }
+        // True between messages, where the stream may cleanly end.
+        bool idle() const { return depth == 0 && state == tag; }
+        enum { default_max_size = 65535, max_depth = 8 };
+    private:
+        enum State { tag, length, length_bytes, contents };
+        size_t scan(const std::uint8_t* b,const std::uint8_t* e,bool& complete);
+        void header(std::uint8_t t,std::uint32_t len);
+        void emit(const std::uint8_t* b,const std::uint8_t* e);
+        Handler handler;
+        size_t max_size;
+        State state;
+        std::uint8_t type;
+        std::uint8_t length_left;
+        std::uint32_t len;
+        // Offset in the current message and where each open constructed
+        // element, outermost first, and the primitive being skipped end.
+        std::uint32_t offset;
+        std::uint32_t skip_end;
+        size_t depth;
+        std::uint32_t ends[max_depth];
+        std::pmr::vector<std::uint8_t> pending;
+        std::pmr::monotonic_buffer_resource arena;
+    };
+}
+
+namespace std
+{
+    template <> struct hash<snmp::Oid>
+    {
+        size_t operator()(const snmp::Oid& oid) const { return oid.hash(); }
     };
 }
 
@@ -0,0 +1,485 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <random>
+#include <unordered_set>
+#include <memory_resource>
+#include <cstdlib>
+#include <cstdio>
+#include <memory>
+#include <new>
+#include "snmp.h"
+#include "mib.h"
+#include "snapshot.h"
+#include "table.h"
+
+// Every allocation made through the global operator new is counted, which
+// covers the default memory resource as well. The benchmarks are single
+// threaded, so plain counters are enough.
+static size_t allocations = 0;
+static size_t allocated = 0;
+
+// Once these are inlined GCC sees a pointer from operator new reach free()
+// and warns, though every form here allocates with malloc or aligned_alloc
+// and releases with free, which is the matching pair.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t n)
+{
+    allocations++;
+    allocated += n;
+    void* p = std::malloc(n ? n : 1);
+    if(p == 0)
+        throw std::bad_alloc();
+    return p;
+}
+
+// The default memory resource asks for aligned storage.
+void* operator new(size_t n,std::align_val_t a)
+{
+    allocations++;
+    allocated += n;
+    size_t alignment = std::max(sizeof(void*),static_cast<size_t>(a));
+    void* p = std::aligned_alloc(alignment,(n + alignment - 1) / alignment * alignment);
+    if(p == 0)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p,size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p,std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p,size_t,std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+// Reference operators comparing one subidentifier at a time through
+// Oid::operator[], as the library did before comparing whole arrays.
+static bool referenceEqual(const snmp::Oid& oid1,const snmp::Oid& oid2)
+{
+    if(oid1.getType() == oid2.getType() && oid1.getValueSize() == oid2.getValueSize())
+    {
+        for(size_t i = 0;i < oid1.getValueSize();i++)
+        {
+            if(oid1[i] != oid2[i])
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+static bool referenceLess(const snmp::Oid& oid1,const snmp::Oid& oid2)
+{
+    size_t len = std::min(oid1.getValueSize(),oid2.getValueSize());
+    for(size_t i = 0;i < len;i++)
+    {
+        if(oid1[i] != oid2[i])
+            return oid1[i] < oid2[i];
+    }
+    return oid1.getValueSize() < oid2.getValueSize();
+}
+
+struct Result
+{
+    std::string name;
+    size_t ops;
+    double ns;
+    double bytes;
+    double allocs;
+};
+
+static std::vector<Result> results;
+static int runs = 5;
+// Keeps the compiler from dropping the work being measured.
+static size_t sink = 0;
+// Backing store of the arena benchmarks, large enough for the walk.
+static std::uint8_t arena_buffer[65536];
+
+// Calls setup and then f, which performs ops operations, once to warm up
+// and then runs times. The median time and the allocations of the last run
+// are reported per operation.
+template <typename S,typename F> static void benchmark(const char* name,size_t ops,S setup,F f)
+{
+    std::vector<double> times;
+    size_t allocs = 0;
+    size_t bytes = 0;
+    for(int run = 0;run <= runs;run++)
+    {
+        setup();
+        size_t a = allocations;
+        size_t b = allocated;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        f();
+        double ns = std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now() - start).count();
+        allocs = allocations - a;
+        bytes = allocated - b;
+        if(run > 0)
+            times.push_back(ns);
+    }
+    std::sort(times.begin(),times.end());
+    Result r = {name,ops,times[times.size() / 2] / ops,double(bytes) / ops,double(allocs) / ops};
+    results.push_back(r);
+    std::cout << std::left << std::setw(40) << r.name << std::right << std::fixed << std::setprecision(2)
+        << std::setw(12) << r.ns << " ns/op" << std::setw(12) << r.bytes << " B/op" << std::setw(10) << r.allocs << " allocs/op" << std::endl;
+}
+
+template <typename F> static void benchmark(const char* name,size_t ops,F f)
+{
+    benchmark(name,ops,[]() {},f);
+}
+
+// ifTable style OIDs (1.3.6.1.2.1.2.2.1.column.index) in random order.
+static std::vector<snmp::Oid> makeOids(size_t n)
+{
+    std::uint32_t arcs[] = {1,3,6,1,2,1,2,2,1,0,0};
+    std::vector<snmp::Oid> oids;
+    std::mt19937 rng(42);
+    for(size_t i = 0;i < n;i++)
+    {
+        arcs[9] = 1 + i % 22;
+        arcs[10] = 1 + i / 22 * 7;
+        oids.push_back(snmp::Oid(arcs,sizeof(arcs) / sizeof(std::uint32_t)));
+    }
+    std::shuffle(oids.begin(),oids.end(),rng);
+    return oids;
+}
+
+static std::vector<std::uint8_t> encode(const snmp::Message& m)
+{
+    std::vector<std::uint8_t> d;
+    m.write(d);
+    return d;
+}
+
+static snmp::Message makeMessage(snmp::Complex::Type type,const snmp::Varbinds& vbs)
+{
+    snmp::Message m(snmp::v2c,"public");
+    m.setPDU(snmp::PDU(type,0x1234abcd,0,0,vbs));
+    return m;
+}
+
+typedef snmp::oid<1,3,6,1,2,1,1,1,0> sysDescr;
+typedef snmp::oid<1,3,6,1,2,1,1,2,0> sysObjectID;
+typedef snmp::oid<1,3,6,1,2,1,1,3,0> sysUpTime;
+typedef snmp::oid<1,3,6,1,2,1,1,5,0> sysName;
+
+// What a poller typically asks for.
+static snmp::Message makeGetRequest()
+{
+    snmp::Varbinds vbs;
+    vbs.addVarbind(snmp::Varbind(sysDescr::get()));
+    vbs.addVarbind(snmp::Varbind(sysObjectID::get()));
+    vbs.addVarbind(snmp::Varbind(sysUpTime::get()));
+    vbs.addVarbind(snmp::Varbind(sysName::get()));
+    return makeMessage(snmp::Complex::get_request,vbs);
+}
+
+static snmp::Message makeGetResponse()
+{
+    snmp::Varbinds vbs;
+    vbs.addVarbind(snmp::Varbind(sysDescr::get(),snmp::OctetString("Linux gateway 6.1.0-18-amd64 #1 SMP PREEMPT_DYNAMIC x86_64")));
+    vbs.addVarbind(snmp::Varbind(sysObjectID::get(),snmp::Oid("1.3.6.1.4.1.8072.3.2.10")));
+    vbs.addVarbind(snmp::Varbind(sysUpTime::get(),snmp::TimeTicks(123456789)));
+    vbs.addVarbind(snmp::Varbind(sysName::get(),snmp::OctetString("gateway.example.org")));
+    return makeMessage(snmp::Complex::get_response,vbs);
+}
+
+// One GetBulk response of an ifTable walk: rows interfaces by six columns.
+static void addRows(snmp::Varbinds& vbs,std::uint32_t rows)
+{
+    std::uint32_t arcs[] = {1,3,6,1,2,1,2,2,1,0,0};
+    for(std::uint32_t i = 1;i <= rows;i++)
+    {
+        arcs[10] = i;
+        arcs[9] = 1;
+        vbs.addVarbind(snmp::Varbind(snmp::Oid(arcs,11),snmp::Integer(i)));
+        arcs[9] = 2;
+        vbs.addVarbind(snmp::Varbind(snmp::Oid(arcs,11),snmp::OctetString("GigabitEthernet0/" + std::to_string(i))));
+        arcs[9] = 3;
+        vbs.addVarbind(snmp::Varbind(snmp::Oid(arcs,11),snmp::Integer(6)));
+        arcs[9] = 5;
+        vbs.addVarbind(snmp::Varbind(snmp::Oid(arcs,11),snmp::Gauge(1000000000)));
+        arcs[9] = 10;
+        vbs.addVarbind(snmp::Varbind(snmp::Oid(arcs,11),snmp::Counter(3000000000u + i * 7919)));
+        arcs[9] = 16;
+        vbs.addVarbind(snmp::Varbind(snmp::Oid(arcs,11),snmp::Counter(2000000000u + i * 104729)));
+    }
+}
+
+static snmp::Message makeWalkResponse()
+{
+    snmp::Varbinds vbs;
+    addRows(vbs,10);
+    return makeMessage(snmp::Complex::get_response,vbs);
+}
+
+static void messageCodec(const char* label,const snmp::Message& message,size_t n)
+{
+    std::vector<std::uint8_t> data = encode(message);
+    const std::uint8_t* b = data.data();
+    const std::uint8_t* e = b + data.size();
+    std::string prefix = std::string("message ") + label + " ";
+    std::cout << label << ": " << data.size() << " bytes, " << message.getPDU().getVarbinds().getValue().size() << " varbinds" << std::endl;
+
+    benchmark((prefix + "read").c_str(),n,[&]() {
+        for(size_t i = 0;i < n;i++)
+        {
+            snmp::Message m;
+            m.read(b,e);
+            sink += m.getPDU().getVarbinds().getValue().size();
+        }
+    });
+    benchmark((prefix + "read (arena)").c_str(),n,[&]() {
+        for(size_t i = 0;i < n;i++)
+        {
+            std::pmr::monotonic_buffer_resource arena(arena_buffer,sizeof(arena_buffer),std::pmr::null_memory_resource());
+            snmp::Message m(&arena);
+            m.read(b,e);
+            sink += m.getPDU().getVarbinds().getValue().size();
+        }
+    });
+    benchmark((prefix + "view").c_str(),n,[&]() {
+        snmp::MessageView v;
+        for(size_t i = 0;i < n;i++)
+        {
+            v.read(b,e);
+            sink += v.getVarbindCount();
+        }
+    });
+
+    snmp::Message m;
+    m.read(b,e);
+    benchmark((prefix + "write").c_str(),n,[&]() {
+        std::vector<std::uint8_t> d;
+        for(size_t i = 0;i < n;i++)
+        {
+            d.clear();
+            m.write(d);
+            sink += d.size();
+        }
+    });
+    benchmark((prefix + "encode").c_str(),n,[&]() {
+        std::uint8_t buffer[4096];
+        for(size_t i = 0;i < n;i++)
+        {
+            snmp::Encoder enc(buffer,sizeof(buffer));
+            enc.write(m);
+            sink += enc.size();
+        }
+    });
+}
+
+static void oidConstruction()
+{
+    const size_t n = 50000;
+    const std::uint32_t arcs[] = {1,3,6,1,2,1,2,2,1,10,7};
+    std::uint32_t long_arcs[24];
+    for(size_t i = 0;i < 24;i++)
+        long_arcs[i] = i < 2 ? arcs[i] : 1000 + i;
+    snmp::Oid oid(arcs,11);
+    std::vector<std::uint8_t> data;
+    oid.write(data);
+
+    benchmark("oid construct",n,[&]() { for(size_t i = 0;i < n;i++) sink += snmp::Oid(arcs,11).getValueSize(); });
+    benchmark("oid construct (24 arcs)",n,[&]() { for(size_t i = 0;i < n;i++) sink += snmp::Oid(long_arcs,24).getValueSize(); });
+    benchmark("oid copy",n,[&]() { for(size_t i = 0;i < n;i++) sink += snmp::Oid(oid).getValueSize(); });
+    benchmark("oid read",n,[&]() {
+        for(size_t i = 0;i < n;i++)
+        {
+            snmp::Oid o;
+            o.read(data.data(),data.data() + data.size());
+            sink += o.getValueSize();
+        }
+    });
+    benchmark("oid parse",n,[&]() { for(size_t i = 0;i < n;i++) sink += snmp::Oid("1.3.6.1.2.1.2.2.1.10.7").getValueSize(); });
+    benchmark("oid asString",n,[&]() { for(size_t i = 0;i < n;i++) sink += oid.asString().size(); });
+    benchmark("oid format",n,[&]() {
+        char buffer[snmp::Oid::maxStringSize(11)];
+        for(size_t i = 0;i < n;i++)
+            sink += oid.format(buffer,buffer + sizeof(buffer)) - buffer;
+    });
+}
+
+static void oidComparison()
+{
+    const size_t n = 100000;
+    std::vector<snmp::Oid> oids = makeOids(n);
+    std::vector<snmp::Oid> sorted;
+    std::unordered_set<snmp::Oid> set;
+
+    benchmark("oid equal (reference)",n,[&]() { for(size_t i = 1;i < n;i++) sink += referenceEqual(oids[i - 1],oids[i]) || referenceEqual(oids[i],oids[i]); });
+    benchmark("oid equal",n,[&]() { for(size_t i = 1;i < n;i++) sink += oids[i - 1] == oids[i] || oids[i] == oids[i]; });
+    benchmark("oid sort (reference)",n,[&]() { sorted = oids; },[&]() { std::sort(sorted.begin(),sorted.end(),referenceLess); });
+    benchmark("oid sort",n,[&]() { sorted = oids; },[&]() { std::sort(sorted.begin(),sorted.end()); });
+    benchmark("oid hash insert",n,[&]() { set = std::unordered_set<snmp::Oid>(); },[&]() { set.insert(oids.begin(),oids.end()); });
+    benchmark("oid hash find",n,[&]() { for(size_t i = 0;i < n;i++) sink += set.count(oids[i]); });
+}
+
+static void varbindsBuilding()
+{
+    const size_t n = 500;
+    benchmark("varbinds build (60 varbinds)",n,[&]() {
+        for(size_t i = 0;i < n;i++)
+        {
+            snmp::Varbinds vbs;
+            addRows(vbs,10);
+            sink += vbs.getSize();
+        }
+    });
+
+    // The same list built in place, the way the agent fills a response.
+    std::vector<snmp::Oid> oids;
+    std::uint32_t arcs[] = {1,3,6,1,2,1,2,2,1,10,0};
+    for(std::uint32_t i = 1;i <= 60;i++)
+    {
+        arcs[10] = i;
+        oids.push_back(snmp::Oid(arcs,11));
+    }
+    benchmark("varbinds emplace (60 varbinds)",n,[&]() {
+        for(size_t i = 0;i < n;i++)
+        {
+            snmp::Varbinds vbs;
+            vbs.reserve(oids.size());
+            for(size_t j = 0;j < oids.size();j++)
+                vbs.emplaceVarbind(oids[j],snmp::Counter(3000000000u + j));
+            sink += vbs.getSize();
+        }
+    });
+    benchmark("varbinds emplace (60, arena)",n,[&]() {
+        for(size_t i = 0;i < n;i++)
+        {
+            std::pmr::monotonic_buffer_resource arena(arena_buffer,sizeof(arena_buffer),std::pmr::null_memory_resource());
+            snmp::Varbinds vbs(&arena);
+            vbs.reserve(oids.size());
+            for(size_t j = 0;j < oids.size();j++)
+                vbs.emplaceVarbind(oids[j],snmp::Counter(3000000000u + j));
+            sink += vbs.getSize();
+        }
+    });
+}
+
+// Lookups of the agent, from a registry of scalars and from a snapshot of
+// it mapped back from disk.
+static void mibLookup()
+{
+    const size_t n = 20000;
+    std::vector<snmp::Oid> oids = makeOids(n);
+    snmp::MibRegistry mib;
+    benchmark("mib register (20000 scalars)",n,[&]() { mib = snmp::MibRegistry(); },[&]() {
+        for(size_t i = 0;i < n;i++)
+            mib.addScalar(oids[i],[](const snmp::Oid& oid) { return snmp::Varbind(oid,snmp::Counter(3000000000u)); });
+    });
+    const char* path = "snmp_bench.snapshot";
+    snmp::MibSnapshot::write(path,mib);
+    std::unique_ptr<snmp::MibSnapshot> snapshot;
+    benchmark("mib snapshot open (20000 instances)",n,[&]() { snapshot.reset(); },[&]() { snapshot.reset(new snmp::MibSnapshot(path)); });
+    snmp::Varbind vb;
+    benchmark("mib registry get",n,[&]() { for(size_t i = 0;i < n;i++) sink += mib.get(oids[i],vb); });
+    benchmark("mib snapshot get",n,[&]() { for(size_t i = 0;i < n;i++) sink += snapshot->get(oids[i],vb); });
+    benchmark("mib registry getNext",n,[&]() { for(size_t i = 0;i < n;i++) sink += mib.getNext(oids[i],vb); });
+    benchmark("mib snapshot getNext",n,[&]() { for(size_t i = 0;i < n;i++) sink += snapshot->getNext(oids[i],vb); });
+    std::remove(path);
+
+    // The same instances as a table of 22 counter columns.
+    snmp::MibTable table(snmp::Oid("1.3.6.1.2.1.2.2.1"));
+    for(std::uint32_t c = 1;c <= 22;c++)
+        table.addColumn(c,snmp::Primitive::tcounter);
+    const size_t rows = (n + 21) / 22;
+    for(size_t r = 0;r < rows;r++)
+        table.addRow(1 + r * 7);
+    benchmark("mib table get",n,[&]() { for(size_t i = 0;i < n;i++) sink += table.get(oids[i],vb); });
+    benchmark("mib table getNext",n,[&]() { for(size_t i = 0;i < n;i++) sink += table.getNext(oids[i],vb); });
+    std::vector<std::uint32_t> counters(rows,3000000000u);
+    benchmark("mib table setColumn (per cell)",rows * 22,[&]() {
+        for(std::uint32_t c = 1;c <= 22;c++)
+            table.setColumn(c,0,counters.data(),counters.size());
+    });
+}
+
+// Results as JSON, one object per benchmark, so that runs can be compared
+// with any script.
+static bool save(const char* path)
+{
+    std::ofstream out(path);
+    out << "{\n  \"runs\": " << runs << ",\n";
+#ifdef __OPTIMIZE__
+    out << "  \"optimized\": true,\n";
+#else
+    out << "  \"optimized\": false,\n";
+#endif
+    out << "  \"benchmarks\": [\n" << std::fixed << std::setprecision(2);
+    for(size_t i = 0;i < results.size();i++)
+    {
+        const Result& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"ops\": " << r.ops << ", \"ns_per_op\": " << r.ns
+            << ", \"bytes_per_op\": " << r.bytes << ", \"allocs_per_op\": " << r.allocs << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return bool(out);
+}
+
+// snmp_bench [results.json [runs]]
+int main(int argc,char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : "snmp_bench.json";
+    if(argc > 2)
+        runs = std::max(1,std::atoi(argv[2]));
+
+    messageCodec("get_request",makeGetRequest(),20000);
+    messageCodec("get_response",makeGetResponse(),20000);
+    messageCodec("walk_response",makeWalkResponse(),1000);
+    oidConstruction();
+    oidComparison();
+    varbindsBuilding();
+    mibLookup();
+
+    if(!save(path))
+    {
+        std::cerr << "cannot write " << path << std::endl;
+        return 1;
+    }
+    std::cout << "results written to " << path << (sink == 0 ? "\n" : "") << std::endl;
+    return 0;
+}
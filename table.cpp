@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <mutex>
+#include "table.h"
+
+namespace snmp
+{
+    static bool indexLess(const std::vector<std::uint32_t>& a,const std::uint32_t* b,size_t n)
+    {
+        return std::lexicographical_compare(a.begin(),a.end(),b,b + n);
+    }
+
+    static bool indexGreater(const std::vector<std::uint32_t>& a,const std::uint32_t* b,size_t n)
+    {
+        return std::lexicographical_compare(b,b + n,a.begin(),a.end());
+    }
+
+    MibTable::MibTable(const Oid& _entry) : entry(_entry), capacity(0)
+    {
+        // Instances are built from entry as dotted arcs, which start with 1.3.
+        if(entry.getValueSize() == 0 || entry[0] != 0x2b || entry.getValueSize() + 2 > max_subidentifiers)
+            throw Except(&entry,Except::bad_oid);
+    }
+
+    std::vector<MibTable::Column>::iterator MibTable::column(std::uint32_t number)
+    {
+        std::vector<Column>::iterator it = std::lower_bound(columns.begin(),columns.end(),number,[](const Column& c,std::uint32_t n) { return c.number < n; });
+        return it != columns.end() && it->number == number ? it : columns.end();
+    }
+
+    std::vector<MibTable::Column>::const_iterator MibTable::column(std::uint32_t number) const
+    {
+        std::vector<Column>::const_iterator it = std::lower_bound(columns.begin(),columns.end(),number,[](const Column& c,std::uint32_t n) { return c.number < n; });
+        return it != columns.end() && it->number == number ? it : columns.end();
+    }
+
+    // Position in order of the row with index, npos if there is none; with
+    // next of the first row after index, order.size() if there is none.
+    size_t MibTable::position(const std::uint32_t* index,size_t n,bool next) const
+    {
+        std::vector<std::uint32_t>::const_iterator it;
+        if(next)
+        {
+            it = std::partition_point(order.begin(),order.end(),[&](std::uint32_t row) { return !indexGreater(indexes[row],index,n); });
+            return it - order.begin();
+        }
+        it = std::partition_point(order.begin(),order.end(),[&](std::uint32_t row) { return indexLess(indexes[row],index,n); });
+        if(it == order.end() || !std::equal(indexes[*it].begin(),indexes[*it].end(),index,index + n))
+            return npos;
+        return it - order.begin();
+    }
+
+    void MibTable::reserve(Column& c,size_t n)
+    {
+        std::unique_ptr<std::atomic<std::uint32_t>[]> numbers(new std::atomic<std::uint32_t>[n]);
+        for(size_t i = 0;i < n;i++)
+            numbers[i].store(i < capacity && c.numbers ? c.numbers[i].load(std::memory_order_relaxed) : 0,std::memory_order_relaxed);
+        c.numbers = std::move(numbers);
+    }
+
+    void MibTable::addColumn(std::uint32_t number,std::uint8_t type)
+    {
+        switch(type)
+        {
+        case Primitive::tinteger:
+        case Primitive::tcounter:
+        case Primitive::tgauge:
+        case Primitive::ttime_ticks:
+        case Primitive::tip_address:
+        case Primitive::tocted_string:
+            break;
+        default:
+            throw Except(&entry,Except::bad_type);
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        std::vector<Column>::iterator it = std::lower_bound(columns.begin(),columns.end(),number,[](const Column& c,std::uint32_t n) { return c.number < n; });
+        if(it != columns.end() && it->number == number)
+            return;
+        Column c;
+        c.number = number;
+        c.type = type;
+        if(type == Primitive::tocted_string)
+            c.strings.resize(indexes.size());
+        else
+            reserve(c,capacity);
+        columns.insert(it,std::move(c));
+    }
+
+    size_t MibTable::addRow(const std::uint32_t* index,size_t n)
+    {
+        if(n == 0 || entry.getValueSize() + 1 + n > max_subidentifiers)
+            throw Except(&entry,Except::bad_oid);
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        std::vector<std::uint32_t>::iterator it = std::partition_point(order.begin(),order.end(),[&](std::uint32_t row) { return indexLess(indexes[row],index,n); });
+        if(it != order.end() && std::equal(indexes[*it].begin(),indexes[*it].end(),index,index + n))
+            return *it;
+        std::uint32_t row;
+        if(free_rows.empty())
+        {
+            row = indexes.size();
+            indexes.emplace_back();
+            if(indexes.size() > capacity)
+            {
+                size_t grown = std::max<size_t>(16,capacity * 2);
+                for(Column& c : columns)
+                {
+                    if(c.type != Primitive::tocted_string)
+                        reserve(c,grown);
+                }
+                capacity = grown;
+            }
+            for(Column& c : columns)
+            {
+                if(c.type == Primitive::tocted_string)
+                    c.strings.resize(indexes.size());
+            }
+        }
+        else
+        {
+            row = free_rows.back();
+            free_rows.pop_back();
+            // Stale writes to the removed row may have landed since.
+            for(Column& c : columns)
+            {
+                if(c.type != Primitive::tocted_string)
+                    c.numbers[row].store(0,std::memory_order_relaxed);
+            }
+        }
+        indexes[row].assign(index,index + n);
+        order.insert(it,row);
+        return row;
+    }
+
+    size_t MibTable::findRow(const std::uint32_t* index,size_t n) const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        size_t p = position(index,n,false);
+        return p == npos ? npos : order[p];
+    }
+
+    void MibTable::removeRow(size_t row)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if(row >= indexes.size() || indexes[row].empty())
+            return;
+        order.erase(order.begin() + position(indexes[row].data(),indexes[row].size(),false));
+        for(Column& c : columns)
+        {
+            if(c.type == Primitive::tocted_string)
+                std::string().swap(c.strings[row]);
+        }
+        indexes[row].clear();
+        free_rows.push_back(row);
+    }
+
+    size_t MibTable::getRows() const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return order.size();
+    }
+
+    void MibTable::set(std::uint32_t number,size_t row,std::uint32_t value)
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        std::vector<Column>::iterator c = column(number);
+        if(c != columns.end() && c->type != Primitive::tocted_string && row < indexes.size())
+            c->numbers[row].store(value,std::memory_order_relaxed);
+    }
+
+    void MibTable::set(std::uint32_t number,size_t row,std::string_view value)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        std::vector<Column>::iterator c = column(number);
+        if(c != columns.end() && c->type == Primitive::tocted_string && row < indexes.size() && !indexes[row].empty())
+            c->strings[row].assign(value.data(),value.size());
+    }
+
+    void MibTable::setColumn(std::uint32_t number,size_t first,const std::uint32_t* values,size_t n)
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        std::vector<Column>::iterator c = column(number);
+        if(c == columns.end() || c->type == Primitive::tocted_string || first >= indexes.size())
+            return;
+        n = std::min(n,indexes.size() - first);
+        std::atomic<std::uint32_t>* cells = c->numbers.get() + first;
+        for(size_t i = 0;i < n;i++)
+            cells[i].store(values[i],std::memory_order_relaxed);
+    }
+
+    // Instance of the cell of row in column c, entry.c.index.
+    Oid MibTable::instance(const Column& c,std::uint32_t row) const
+    {
+        std::uint32_t arcs[max_subidentifiers + 1] = {1,3};
+        size_t n = 2;
+        for(size_t i = 1;i < entry.getValueSize();i++)
+            arcs[n++] = entry[i];
+        arcs[n++] = c.number;
+        for(std::uint32_t a : indexes[row])
+            arcs[n++] = a;
+        return Oid(arcs,n);
+    }
+
+    void MibTable::value(const Column& c,std::uint32_t row,const Oid& oid,Varbind& vb) const
+    {
+        if(c.type == Primitive::tocted_string)
+        {
+            vb = Varbind(oid,OctetString(c.strings[row]));
+            return;
+        }
+        std::uint32_t v = c.numbers[row].load(std::memory_order_relaxed);
+        switch(c.type)
+        {
+        case Primitive::tinteger:
+            vb = Varbind(oid,Integer(std::int32_t(v)));
+            break;
+        case Primitive::tcounter:
+            vb = Varbind(oid,Counter(v));
+            break;
+        case Primitive::tgauge:
+            vb = Varbind(oid,Gauge(v));
+            break;
+        case Primitive::ttime_ticks:
+            vb = Varbind(oid,TimeTicks(v));
+            break;
+        default:
+            vb = Varbind(oid,IpAddress(v));
+            break;
+        }
+    }
+
+    bool MibTable::get(const Oid& oid,Varbind& vb)
+    {
+        size_t length = entry.getValueSize();
+        if(oid.getValueSize() < length + 2 || !std::equal(entry.getValue(),entry.getValue() + length,oid.getValue()))
+            return false;
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        std::vector<Column>::const_iterator c = column(oid[length]);
+        if(c == columns.end())
+            return false;
+        size_t p = position(oid.getValue() + length + 1,oid.getValueSize() - length - 1,false);
+        if(p == npos)
+            return false;
+        value(*c,order[p],oid,vb);
+        return true;
+    }
+
+    bool MibTable::getNext(const Oid& oid,Varbind& vb)
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if(order.empty() || columns.empty())
+            return false;
+        const std::uint32_t* o = oid.getValue();
+        const std::uint32_t* e = entry.getValue();
+        size_t length = entry.getValueSize();
+        size_t m = std::min<size_t>(oid.getValueSize(),length);
+        std::pair<const std::uint32_t*,const std::uint32_t*> d = std::mismatch(o,o + m,e);
+        std::vector<Column>::const_iterator c = columns.begin();
+        size_t p = 0;
+        if(d.first != o + m)
+        {
+            // Wholly before the table, or after it.
+            if(*d.first > *d.second)
+                return false;
+        }
+        else if(oid.getValueSize() > length)
+        {
+            // Within the table: the next row of the same column, else the
+            // first row of the next column.
+            std::uint32_t number = o[length];
+            c = std::lower_bound(columns.begin(),columns.end(),number,[](const Column& c,std::uint32_t n) { return c.number < n; });
+            if(c != columns.end() && c->number == number)
+            {
+                p = position(o + length + 1,oid.getValueSize() - length - 1,true);
+                if(p == order.size())
+                {
+                    c++;
+                    p = 0;
+                }
+            }
+            if(c == columns.end())
+                return false;
+        }
+        value(*c,order[p],instance(*c,order[p]),vb);
+        return true;
+    }
+}
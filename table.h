@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <shared_mutex>
+#include "snmp.h"
+#include "mib.h"
+
+namespace snmp
+{
+    // Conceptual table, such as ifTable, stored by column: each column keeps
+    // its cells in one array in row number order, and the instances,
+    // entry.column.index, are never stored. get and getNext find the column
+    // and the row by binary search of the column numbers and of the row
+    // indexes, GetNext stepping to the next row or the first row of the
+    // next column, and build only the oid they answer with. Numeric cells
+    // are relaxed atomics, so set and setColumn are plain stores that any
+    // thread may make while agents read; adding or removing rows and columns
+    // and writing strings take the table lock exclusively. Register it with
+    // MibRegistry::addSubtree at entry.
+    class MibTable : public MibHandler
+    {
+    public:
+        // entry is the oid of the conceptual row, 1.3.6.1.2.1.2.2.1 for
+        // ifEntry.
+        explicit MibTable(const Oid& entry);
+        MibTable(const MibTable&) = delete;
+        MibTable& operator=(const MibTable&) = delete;
+        // Adds column number column of type Primitive::tinteger, tcounter,
+        // tgauge, ttime_ticks, tip_address or tocted_string; throws
+        // Except::bad_type for other types. Cells of existing rows are zero
+        // or empty.
+        void addColumn(std::uint32_t column,std::uint8_t type);
+        // Adds the row whose instances end with the n subidentifiers of
+        // index, with zero or empty cells, and returns its row number, which
+        // set and setColumn take and which stays the same until the row is
+        // removed. Adding an index again returns its row. Throws
+        // Except::bad_oid for empty or too long indexes.
+        size_t addRow(const std::uint32_t* index,size_t n);
+        size_t addRow(std::uint32_t index) { return addRow(&index,1); }
+        // Row number of index, or npos.
+        size_t findRow(const std::uint32_t* index,size_t n) const;
+        size_t findRow(std::uint32_t index) const { return findRow(&index,1); }
+        void removeRow(size_t row);
+        size_t getRows() const;
+        // Cell writes, column being the column number. Integers are given as
+        // their two's complement. Unknown columns, rows or types are
+        // ignored.
+        void set(std::uint32_t column,size_t row,std::uint32_t value);
+        void set(std::uint32_t column,size_t row,std::string_view value);
+        // Writes values[0,n) to the cells of rows first to first + n - 1,
+        // under a single acquisition of the lock.
+        void setColumn(std::uint32_t column,size_t first,const std::uint32_t* values,size_t n);
+        bool get(const Oid& oid,Varbind& vb);
+        bool getNext(const Oid& oid,Varbind& vb);
+        static const size_t npos = size_t(-1);
+        enum { max_subidentifiers = 128 };
+    private:
+        struct Column
+        {
+            std::uint32_t number;
+            std::uint8_t type;
+            // Numeric cells, capacity of them; strings otherwise.
+            std::unique_ptr<std::atomic<std::uint32_t>[]> numbers;
+            std::vector<std::string> strings;
+        };
+        std::vector<Column>::iterator column(std::uint32_t number);
+        std::vector<Column>::const_iterator column(std::uint32_t number) const;
+        size_t position(const std::uint32_t* index,size_t n,bool next) const;
+        void reserve(Column& c,size_t n);
+        Oid instance(const Column& c,std::uint32_t row) const;
+        void value(const Column& c,std::uint32_t row,const Oid& oid,Varbind& vb) const;
+        Oid entry;
+        // Sorted by number.
+        std::vector<Column> columns;
+        // Index of each row number, empty for removed rows.
+        std::vector<std::vector<std::uint32_t>> indexes;
+        // Row numbers of the rows, sorted by index.
+        std::vector<std::uint32_t> order;
+        std::vector<std::uint32_t> free_rows;
+        size_t capacity;
+        mutable std::shared_mutex mutex;
+    };
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2016  roberto64 <mju7ki89@outlook.com>
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <boost/asio.hpp>
+#include "snmp.h"
+#include "receiver.h"
+#include "datagram.h"
+
+// Link-flap storm against TrapReceiver over the loopback interface: one
+// sender paces v1 linkDown/linkUp traps and v2c linkDown notifications at
+// the given rate, then the delivered count is checked against what was sent.
+//     trap_load [workers [traps/s [seconds]]]
+
+using boost::asio::ip::udp;
+
+enum { burst = 64 };
+
+typedef snmp::oid<1,3,6,1,4,1,8072,3,2,10> enterprise;
+typedef snmp::oid<1,3,6,1,2,1,2,2,1,1> ifIndex;
+typedef snmp::oid<1,3,6,1,6,3,1,1,4,1,0> snmpTrapOID;
+typedef snmp::oid<1,3,6,1,6,3,1,1,5,3> linkDown;
+typedef snmp::oid<1,3,6,1,2,1,1,3,0> sysUpTime;
+
+static std::vector<std::uint8_t> makeTrap(std::uint32_t port,bool up)
+{
+    snmp::Message m(snmp::v1,"public");
+    snmp::Varbinds vbs;
+    vbs.addVarbind(snmp::Varbind(ifIndex::get() + port,snmp::Integer(port)));
+    m.setTrap(snmp::TrapPDU(enterprise::get(),snmp::IpAddress(0x0a000001),up ? snmp::TrapPDU::linkUp : snmp::TrapPDU::linkDown,0,snmp::TimeTicks(123456),vbs));
+    std::vector<std::uint8_t> d;
+    m.write(d);
+    return d;
+}
+
+static std::vector<std::uint8_t> makeNotification(std::uint32_t port)
+{
+    snmp::Message m(snmp::v2c,"public");
+    snmp::Varbinds vbs;
+    vbs.addVarbind(snmp::Varbind(sysUpTime::get(),snmp::TimeTicks(123456)));
+    vbs.addVarbind(snmp::Varbind(snmpTrapOID::get(),linkDown::get()));
+    vbs.addVarbind(snmp::Varbind(ifIndex::get() + port,snmp::Integer(port)));
+    m.setPDU(snmp::PDU(snmp::Complex::snmpv2_trap,port,0,0,vbs));
+    std::vector<std::uint8_t> d;
+    m.write(d);
+    return d;
+}
+
+int main(int argc,char* argv[])
+{
+    size_t workers = argc > 1 ? std::atoi(argv[1]) : 2;
+    double rate = argc > 2 ? std::atof(argv[2]) : 50000;
+    double seconds = argc > 3 ? std::atof(argv[3]) : 2.0;
+
+    std::vector<std::vector<std::uint8_t>> traps;
+    for(std::uint32_t port = 1;port <= 48;port++)
+    {
+        traps.push_back(makeTrap(port,false));
+        traps.push_back(makeTrap(port,true));
+        traps.push_back(makeNotification(port));
+    }
+
+    snmp::TrapReceiver receiver(udp::endpoint(boost::asio::ip::address_v4::loopback(),0),workers);
+    std::atomic<std::uint64_t> v1(0);
+    std::atomic<std::uint64_t> v2(0);
+    receiver.addSink([&](snmp::Span<snmp::Notification> batch) {
+        for(const snmp::Notification& n : batch)
+        {
+            if(n.message.getPDUType() == snmp::Complex::trap)
+                v1.fetch_add(1,std::memory_order_relaxed);
+            else
+                v2.fetch_add(1,std::memory_order_relaxed);
+        }
+    });
+    receiver.start();
+
+    boost::asio::io_service io_service;
+    udp::socket s(io_service,udp::endpoint(udp::v4(),0));
+    snmp::DatagramBatch out(burst,0);
+    std::uint64_t sent = 0;
+    std::uint64_t total = std::uint64_t(rate * seconds);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while(sent < total)
+    {
+        // Keeps to the rate by sending whatever is due, a burst at most.
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::uint64_t due = std::min<std::uint64_t>(total,std::uint64_t(elapsed * rate));
+        if(due <= sent)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        out.clear();
+        for(;sent < due && !out.full();sent++)
+        {
+            const std::vector<std::uint8_t>& t = traps[sent % traps.size()];
+            out.push(t.data(),t.size(),receiver.getEndpoint());
+        }
+        boost::system::error_code ec;
+        for(size_t n = 0;n < out.size();)
+        {
+            n += out.send(s.native_handle(),n,ec);
+            if(ec)
+                n++;
+        }
+    }
+    double send_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // Gives the socket buffer time to drain before stopping.
+    for(int i = 0;i < 50 && receiver.getReceived() < sent;i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    receiver.stop();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "workers " << workers << ", sent " << sent << " in " << std::fixed << std::setprecision(2) << send_time << " s" << std::endl;
+    std::cout << "received " << receiver.getReceived() << ", delivered " << receiver.getDelivered() << " (v1 " << v1 << ", v2c " << v2 << "), malformed " << receiver.getMalformed()
+        << ", lost " << sent - receiver.getDelivered() << std::endl;
+    std::cout << std::setprecision(0) << receiver.getDelivered() / elapsed << " traps/s" << std::endl;
+    return receiver.getDelivered() == sent ? 0 : 1;
+}